@@ -0,0 +1,484 @@
+#include "_color.h"
+#include "_ecs.h"
+#include "_math.h"
+#include "_radix_sort.h"
+#include "_renderer.h"
+#include "_tga.h"
+#include "_window.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <numeric>
+#include <string_view>
+
+
+// Times the hot kernels on their own, so that a regression in one of them shows up instead of getting lost in the
+// noise of a whole frame. Every kernel reports the best time per operation out of several batches, and its
+// throughput in the unit that fits it. Kernels without a visible result, like the radix sort, are checked against a
+// reference before they are timed.
+//
+//   renderer_micro_bench [--filter <substring>] [--min-time <milliseconds>] [--format csv|json] [--output <path>]
+
+
+struct Bench_Config {
+    std::string filter;            // only kernels with this in their name, all when empty
+    f64 min_time_ms = 200.0;       // per kernel, spread over num_batches
+    bool is_json = false;
+    std::string output_path;       // stdout when empty
+};
+
+
+struct Kernel_Result {
+    std::string name;
+    f64 ns_per_op;
+    f64 throughput;                // units per second
+    std::string_view unit;
+};
+
+
+// Batches per kernel, the fastest one is reported. Interruptions only ever make a batch slower.
+constexpr u32 num_batches = 10;
+
+// Elements of the input arrays of the math and color kernels, small enough to stay in the L1 cache
+constexpr usize num_elements = 256;
+
+constexpr i32 width = 1280;
+constexpr i32 height = 720;
+
+
+static bool parse_args(const i32 argc, char** argv, Bench_Config& config) {
+    for (i32 arg_index = 1; arg_index < argc; ++arg_index) {
+        const std::string_view arg = argv[arg_index];
+
+        if (arg_index + 1 >= argc) {
+            ERR("missing value for " << arg);
+            return false;
+        }
+        const std::string_view value = argv[++arg_index];
+
+        bool is_valid = true;
+        if (arg == "--filter") {
+            config.filter = value;
+        } else if (arg == "--min-time") {
+            const auto [end, error] = std::from_chars(value.data(), value.data() + value.size(), config.min_time_ms);
+            is_valid = error == std::errc{} && end == value.data() + value.size();
+        } else if (arg == "--format") {
+            is_valid = value == "csv" || value == "json";
+            config.is_json = value == "json";
+        } else if (arg == "--output") {
+            config.output_path = value;
+        } else {
+            ERR("unknown argument " << arg);
+            return false;
+        }
+
+        if (!is_valid) {
+            ERR("invalid value " << value << " for " << arg);
+            return false;
+        }
+    }
+
+    if (config.min_time_ms <= 0.0) {
+        ERR("min time has to be positive");
+        return false;
+    }
+    return true;
+}
+
+
+// Makes the compiler assume that value is read, so that the work producing it can't be optimized away
+template<typename T>
+static void keep(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+
+struct Micro_Bench {
+    const Bench_Config& config;
+    std::vector<Kernel_Result> results;
+
+    // kernel does ops_per_call operations per call, each of them worth units_per_op of throughput
+    void run(const std::string_view name,
+             const u64 ops_per_call,
+             const f64 units_per_op,
+             const std::string_view unit,
+             const std::function<void()>& kernel) {
+        if (!config.filter.empty() && name.find(config.filter) == std::string_view::npos) {
+            return;
+        }
+
+        using Clock = std::chrono::steady_clock;
+        auto time_calls_ns = [&](const u64 num_calls) -> f64 {
+            const auto start = Clock::now();
+            for (u64 call = 0; call < num_calls; ++call) {
+                kernel();
+            }
+            return std::chrono::duration<f64, std::nano>(Clock::now() - start).count();
+        };
+
+        // Warm up caches and branch predictors, then grow the batch until it fills its share of the time
+        time_calls_ns(1);
+
+        const f64 batch_ns = config.min_time_ms * 1e6 / num_batches;
+        u64 num_calls = 1;
+        while (time_calls_ns(num_calls) < batch_ns / 2.0 && num_calls < (u64{1} << 40)) {
+            num_calls *= 2;
+        }
+
+        f64 best_ns = std::numeric_limits<f64>::max();
+        for (u32 batch = 0; batch < num_batches; ++batch) {
+            best_ns = std::min(best_ns, time_calls_ns(num_calls));
+        }
+
+        const f64 ns_per_op = best_ns / static_cast<f64>(num_calls * ops_per_call);
+        results.emplace_back() = Kernel_Result{
+            .name = std::string{name},
+            .ns_per_op = ns_per_op,
+            .throughput = units_per_op * 1e9 / ns_per_op,
+            .unit = unit,
+        };
+    }
+};
+
+
+// Deterministic inputs in [-1, 1), varied enough that no branch or value repeats in a pattern the kernels could
+// benefit from
+static f32 next_input(u32& state) {
+    state = (state * 1664525u) + 1013904223u;
+    return (static_cast<f32>(state >> 8) / static_cast<f32>(1u << 24) * 2.f) - 1.f;
+}
+
+
+static void bench_math(Micro_Bench& bench) {
+    u32 state = 1;
+    std::vector<Mat4> mats_a(num_elements);
+    std::vector<Mat4> mats_b(num_elements);
+    std::vector<Mat4> mats_out(num_elements);
+    std::vector<Vec4> vecs4(num_elements);
+    std::vector<Vec4> vecs4_out(num_elements);
+    std::vector<Vec3> vecs3_a(num_elements);
+    std::vector<Vec3> vecs3_b(num_elements);
+    std::vector<Vec3> vecs3_out(num_elements);
+
+    for (usize idx = 0; idx < num_elements; ++idx) {
+        for (usize row = 0; row < 4; ++row) {
+            for (usize col = 0; col < 4; ++col) {
+                mats_a[idx][row][col] = next_input(state);
+                mats_b[idx][row][col] = next_input(state);
+            }
+        }
+        vecs4[idx] = Vec4{next_input(state), next_input(state), next_input(state), 1.f};
+        vecs3_a[idx] = Vec3{next_input(state), next_input(state), next_input(state) + 2.f};
+        vecs3_b[idx] = Vec3{next_input(state), next_input(state), next_input(state) + 2.f};
+    }
+
+    bench.run("mat4_mul_mat4", num_elements, 1.0, "ops/s", [&] {
+        for (usize idx = 0; idx < num_elements; ++idx) {
+            mats_out[idx] = mats_a[idx] * mats_b[idx];
+        }
+        keep(mats_out);
+    });
+
+    bench.run("mat4_mul_vec4", num_elements, 1.0, "ops/s", [&] {
+        for (usize idx = 0; idx < num_elements; ++idx) {
+            vecs4_out[idx] = mats_a[idx] * vecs4[idx];
+        }
+        keep(vecs4_out);
+    });
+
+    bench.run("vec3_normalized", num_elements, 1.0, "ops/s", [&] {
+        for (usize idx = 0; idx < num_elements; ++idx) {
+            vecs3_out[idx] = math::normalized(vecs3_a[idx]);
+        }
+        keep(vecs3_out);
+    });
+
+    bench.run("vec3_cross", num_elements, 1.0, "ops/s", [&] {
+        for (usize idx = 0; idx < num_elements; ++idx) {
+            vecs3_out[idx] = math::cross(vecs3_a[idx], vecs3_b[idx]);
+        }
+        keep(vecs3_out);
+    });
+}
+
+
+static void bench_color(Micro_Bench& bench) {
+    u32 state = 2;
+    std::vector<Color> colors(num_elements);
+    std::vector<Color> colors_out(num_elements);
+    std::vector<f32> intensities(num_elements);
+
+    for (usize idx = 0; idx < num_elements; ++idx) {
+        colors[idx] = Color{.hex = state};
+        intensities[idx] = (next_input(state) * 0.5f) + 0.5f;
+    }
+
+    bench.run("color_with_intensity", num_elements, 1.0, "ops/s", [&] {
+        for (usize idx = 0; idx < num_elements; ++idx) {
+            colors_out[idx] = colors[idx].with_intensity(intensities[idx]);
+        }
+        keep(colors_out);
+    });
+}
+
+
+static bool bench_raster(Micro_Bench& bench) {
+    const std::unique_ptr<Registry> reg = std::make_unique<Registry>();
+
+    reg->add<Window_System>();
+    Window_System& window = reg->get<Window_System>();
+    if (!window.init_headless(width, height)) {
+        ERR("failed to set up a " << width << "x" << height << " headless window");
+        return false;
+    }
+
+    reg->add<Render_System>(*reg);
+    const Render_System& renderer = reg->get<Render_System>();
+
+    constexpr f64 num_pixels = static_cast<f64>(width) * static_cast<f64>(height);
+    bench.run("clear_color_buffer", 1, num_pixels * sizeof(Color), "bytes/s", [&] {
+        window.clear_color_buffer(Color::black());
+    });
+
+    // Lines from the center of the screen in every octant, so that both major axes and all step signs are covered
+    constexpr i32 line_length = 256;
+    constexpr std::array<Vec2i, 8> line_ends{{
+        {line_length, 0}, {line_length, line_length / 2}, {line_length / 2, line_length}, {0, line_length},
+        {-line_length, 0}, {-line_length, -line_length / 2}, {-line_length / 2, -line_length}, {0, -line_length},
+    }};
+    const Vec2i center{width / 2, height / 2};
+
+    bench.run("draw_line_256", line_ends.size(), line_length + 1, "pixels/s", [&] {
+        for (const Vec2i end : line_ends) {
+            renderer.draw_line(center, center + end, Color::white());
+        }
+    });
+
+    // Right triangles of both windings, half of a square with sides of side_length pixels each
+    for (const i32 side_length : {4, 16, 64, 256}) {
+        const f32 side = static_cast<f32>(side_length);
+        const Vec2 origin{static_cast<f32>(center.x) - (side / 2.f), static_cast<f32>(center.y) - (side / 2.f)};
+        const std::array<Triangle, 2> triangles{{
+            {origin, origin + Vec2{side, 0.f}, origin + Vec2{0.f, side}},
+            {origin + Vec2{side, 0.f}, origin + Vec2{side, side}, origin + Vec2{0.f, side}},
+        }};
+
+        const std::string name = "draw_triangle_filled_" + std::to_string(side_length);
+        bench.run(name, triangles.size(), side * side / 2.0, "pixels/s", [&] {
+            for (const Triangle& triangle : triangles) {
+                renderer.draw_triangle_filled(triangle, Color::white());
+            }
+        });
+    }
+    return true;
+}
+
+
+// Uncompressed image of the given size in memory, pixels in rows top to bottom
+static std::vector<u8> make_tga(const u16 image_width, const u16 image_height, const u8 bits_per_pixel) {
+    const usize num_bytes = static_cast<usize>(image_width) * image_height * (bits_per_pixel / 8);
+    std::vector<u8> data(tga::Header_View::packed_byte_size_header() + num_bytes);
+
+    const tga::Header_View header{data};
+    header.image_type = static_cast<u8>(tga::Image_Type::Uncompressed_Rgb);
+    header.image.pixel_width = image_width;
+    header.image.pixel_height = image_height;
+    header.image.bits_per_pixel = bits_per_pixel;
+    header.image.descriptor = 0x20;
+
+    u32 state = 3;
+    for (usize idx = header.offset_image(); idx < data.size(); ++idx) {
+        state = (state * 1664525u) + 1013904223u;
+        data[idx] = static_cast<u8>(state >> 24);
+    }
+    return data;
+}
+
+
+static void bench_tga(Micro_Bench& bench) {
+    constexpr u16 image_size = 512;
+
+    for (const u8 bits_per_pixel : {u8{24}, u8{32}}) {
+        std::vector<u8> data = make_tga(image_size, image_size, bits_per_pixel);
+        const tga::Header_View header{data};
+        std::vector<Color> pixels(header.num_pixels());
+
+        const std::string name = "tga_decode_" + std::to_string(bits_per_pixel) + "bit";
+        bench.run(name, 1, static_cast<f64>(header.num_pixels()), "pixels/s", [&] {
+            tga::decode_pixels(header, data, pixels);
+            keep(pixels);
+        });
+    }
+}
+
+
+// Radix sorts keys with their indices as values and compares the result with std::stable_sort
+static bool is_radix_sort_stable_and_ordered(std::vector<u64> keys) {
+    std::vector<u32> values(keys.size());
+    std::iota(values.begin(), values.end(), 0);
+    std::vector<u64> scratch_keys(keys.size());
+    std::vector<u32> scratch_values(keys.size());
+
+    std::vector<u32> expected_values = values;
+    std::stable_sort(expected_values.begin(), expected_values.end(), [&](const u32 a, const u32 b) -> bool {
+        return keys[a] < keys[b];
+    });
+    std::vector<u64> expected_keys(keys.size());
+    for (usize idx = 0; idx < keys.size(); ++idx) {
+        expected_keys[idx] = keys[expected_values[idx]];
+    }
+
+    radix_sort::sort(keys, values, scratch_keys, scratch_values);
+    return keys == expected_keys && values == expected_values;
+}
+
+
+static bool check_radix_sort() {
+    // Floats in ascending order, with -0 before +0, have to map to ascending integers
+    constexpr std::array<f32, 11> ascending_floats{
+        -std::numeric_limits<f32>::infinity(), -1e30f, -2.f, -1.f, -1e-30f, -0.f,
+        0.f, 1e-30f, 1.f, 2.f, std::numeric_limits<f32>::infinity(),
+    };
+    for (usize idx = 1; idx < ascending_floats.size(); ++idx) {
+        if (radix_sort::ordered_bits(ascending_floats[idx - 1]) >= radix_sort::ordered_bits(ascending_floats[idx])) {
+            ERR("ordered_bits doesn't keep " << ascending_floats[idx - 1] << " below " << ascending_floats[idx]);
+            return false;
+        }
+    }
+
+    // Draw keys of mixed sign depths, many of them equal so that stability matters. The constant low bytes get their
+    // passes skipped.
+    u32 state = 4;
+    std::vector<u64> draw_keys(4096);
+    for (u64& key : draw_keys) {
+        const f32 depth = std::round(next_input(state) * 8.f) / 4.f;
+        key = static_cast<u64>(radix_sort::ordered_bits(depth == 0.f ? -0.f : depth)) << 32;
+    }
+    for (usize idx = 0; idx < draw_keys.size(); idx += 3) {
+        draw_keys[idx] = static_cast<u64>(radix_sort::ordered_bits(0.f)) << 32;
+    }
+
+    // Only the lowest byte differs, the single pass leaves the result in the scratch buffers
+    std::vector<u64> single_pass_keys(1000);
+    for (usize idx = 0; idx < single_pass_keys.size(); ++idx) {
+        single_pass_keys[idx] = (idx * 7919) % 251;
+    }
+
+    // Every pass skipped
+    const std::vector<u64> equal_keys(100, 0x0123456789ABCDEFull);
+
+    if (!is_radix_sort_stable_and_ordered(draw_keys) ||
+        !is_radix_sort_stable_and_ordered(single_pass_keys) ||
+        !is_radix_sort_stable_and_ordered(equal_keys) ||
+        !is_radix_sort_stable_and_ordered({})) {
+        ERR("radix sort result differs from std::stable_sort");
+        return false;
+    }
+    return true;
+}
+
+
+static void bench_radix_sort(Micro_Bench& bench) {
+    // Draw keys of a frame, depth in the upper half and a handful of meshes in the lowest bits
+    constexpr usize num_keys = 1 << 16;
+
+    u32 state = 5;
+    std::vector<u64> source_keys(num_keys);
+    for (usize idx = 0; idx < num_keys; ++idx) {
+        const f32 depth = (next_input(state) * 0.5f) + 0.5f;
+        source_keys[idx] = (static_cast<u64>(radix_sort::ordered_bits(depth)) << 32) | (idx % 7);
+    }
+
+    std::vector<u64> keys(num_keys);
+    std::vector<u32> values(num_keys);
+    std::vector<u64> scratch_keys(num_keys);
+    std::vector<u32> scratch_values(num_keys);
+
+    bench.run("radix_sort_64k", num_keys, 1.0, "keys/s", [&] {
+        std::copy(source_keys.begin(), source_keys.end(), keys.begin());
+        std::iota(values.begin(), values.end(), 0);
+        radix_sort::sort(keys, values, scratch_keys, scratch_values);
+        keep(values);
+    });
+
+    // What the radix sort replaces, the same keys and values sorted as pairs
+    std::vector<std::pair<u64, u32>> pairs(num_keys);
+
+    bench.run("std_sort_64k", num_keys, 1.0, "keys/s", [&] {
+        for (usize idx = 0; idx < num_keys; ++idx) {
+            pairs[idx] = {source_keys[idx], static_cast<u32>(idx)};
+        }
+        std::sort(pairs.begin(), pairs.end());
+        keep(pairs);
+    });
+}
+
+
+static void write_results(std::ostream& out, const Bench_Config& config, const std::vector<Kernel_Result>& results) {
+    if (config.is_json) {
+        out << "[\n";
+        for (usize idx = 0; idx < results.size(); ++idx) {
+            const Kernel_Result& result = results[idx];
+            out << "    {\"kernel\": \"" << result.name << "\", \"ns_per_op\": " << result.ns_per_op
+                << ", \"throughput\": " << result.throughput << ", \"unit\": \"" << result.unit << "\"}"
+                << (idx + 1 < results.size() ? ",\n" : "\n");
+        }
+        out << "]\n";
+        return;
+    }
+
+    out << "kernel,ns_per_op,throughput,unit\n";
+    for (const Kernel_Result& result : results) {
+        out << result.name << ',' << result.ns_per_op << ',' << result.throughput << ',' << result.unit << '\n';
+    }
+}
+
+
+i32 main(const i32 argc, char** argv) {
+    Bench_Config config;
+    if (!parse_args(argc, argv, config)) {
+        return EXIT_FAILURE;
+    }
+
+#ifndef NDEBUG
+    WARN("asserts are enabled, build with -DCMAKE_BUILD_TYPE=Release for numbers worth comparing");
+#endif
+
+    if (!check_radix_sort()) {
+        return EXIT_FAILURE;
+    }
+
+    Micro_Bench bench{.config = config, .results = {}};
+    bench_math(bench);
+    bench_color(bench);
+    if (!bench_raster(bench)) {
+        return EXIT_FAILURE;
+    }
+    bench_tga(bench);
+    bench_radix_sort(bench);
+
+    if (config.output_path.empty()) {
+        write_results(std::cout, config, bench.results);
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream file{config.output_path};
+    if (file.fail()) {
+        ERR("failed to open " << config.output_path);
+        return EXIT_FAILURE;
+    }
+    write_results(file, config, bench.results);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,328 @@
+#include "_asset_store.h"
+#include "_bvh.h"
+#include "_camera.h"
+#include "_debug_rotate.h"
+#include "_ecs.h"
+#include "_frame_arena.h"
+#include "_mesh_render.h"
+#include "_renderer.h"
+#include "_tile_raster.h"
+#include "_time.h"
+#include "_transform.h"
+#include "_window.h"
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <string_view>
+
+
+// Renders a procedurally spawned scene headless, for a fixed number of frames with a fixed timestep, and reports frame
+// time percentiles and throughput. Gives a stable number to compare builds and configurations against.
+//
+//   renderer_bench [--spheres <count>] [--cubes <count>] [--detailed-spheres <count>] [--frames <count>]
+//                  [--warm-up <count>] [--width <pixels>] [--height <pixels>] [--format csv|json] [--output <path>]
+//
+// Detailed spheres are subdivided icospheres with levels of detail, each with a small sphere orbiting it as its child.
+
+
+struct Bench_Config {
+    u32 num_spheres = 100;
+    u32 num_cubes = 100;
+    u32 num_detailed_spheres = 20;   // 5120 faces each, the only meshes large enough to get levels of detail
+    u32 num_frames = 300;
+    u32 num_warm_up_frames = 30;   // rendered but not measured, containers and caches settle first
+    i32 width = 1280;
+    i32 height = 720;
+    bool is_json = false;
+    std::string output_path;       // stdout when empty
+};
+
+
+struct Bench_Result {
+    f64 mean_ms;
+    f64 p50_ms;
+    f64 p95_ms;
+    f64 p99_ms;
+    f64 min_ms;
+    f64 max_ms;
+    f64 triangles_per_frame;
+    f64 triangles_per_second;
+    f64 pixels_per_second;     // of the output resolution
+};
+
+
+// Frame simulated by every update, so that runs animate the same way no matter how long frames take
+constexpr f32 fixed_delta_seconds = 1.f / 60.f;
+
+
+// Whole number that fits T, anything else including trailing characters is rejected
+template<typename T>
+static bool parse_number(const std::string_view text, T& number) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), number);
+    return error == std::errc{} && end == text.data() + text.size();
+}
+
+
+static bool parse_args(const i32 argc, char** argv, Bench_Config& config) {
+    for (i32 arg_index = 1; arg_index < argc; ++arg_index) {
+        const std::string_view arg = argv[arg_index];
+
+        if (arg_index + 1 >= argc) {
+            ERR("missing value for " << arg);
+            return false;
+        }
+        const std::string_view value = argv[++arg_index];
+
+        // A mistyped value would otherwise benchmark a different scene than the one asked for, without any warning
+        bool is_valid = true;
+        if (arg == "--spheres") {
+            is_valid = parse_number(value, config.num_spheres);
+        } else if (arg == "--cubes") {
+            is_valid = parse_number(value, config.num_cubes);
+        } else if (arg == "--detailed-spheres") {
+            is_valid = parse_number(value, config.num_detailed_spheres);
+        } else if (arg == "--frames") {
+            is_valid = parse_number(value, config.num_frames);
+        } else if (arg == "--warm-up") {
+            is_valid = parse_number(value, config.num_warm_up_frames);
+        } else if (arg == "--width") {
+            is_valid = parse_number(value, config.width);
+        } else if (arg == "--height") {
+            is_valid = parse_number(value, config.height);
+        } else if (arg == "--format") {
+            is_valid = value == "csv" || value == "json";
+            config.is_json = value == "json";
+        } else if (arg == "--output") {
+            config.output_path = value;
+        } else {
+            ERR("unknown argument " << arg);
+            return false;
+        }
+
+        if (!is_valid) {
+            ERR("invalid value " << value << " for " << arg);
+            return false;
+        }
+    }
+
+    if (config.num_frames == 0 || config.width <= 0 || config.height <= 0) {
+        ERR("frames, width and height have to be positive");
+        return false;
+    }
+
+    // Entities and frames are counted in u32 further on
+    constexpr u64 max_count = std::numeric_limits<u32>::max();
+    const u64 num_entities = static_cast<u64>(config.num_spheres) + config.num_cubes + config.num_detailed_spheres;
+    if (num_entities == 0 || num_entities > max_count) {
+        ERR("spheres, cubes and detailed spheres have to add up to between 1 and " << max_count);
+        return false;
+    }
+    if (static_cast<u64>(config.num_warm_up_frames) + config.num_frames > max_count) {
+        ERR("frames and warm-up frames have to add up to at most " << max_count);
+        return false;
+    }
+    return true;
+}
+
+
+// Rotating spheres and cubes spread through the view volume by a low discrepancy sequence, so that any count covers
+// the screen and the depth range evenly and the same way on every run
+static void spawn_scene(Registry& reg, const Bench_Config& config) {
+    Asset_Store_System& asset_store = reg.get<Asset_Store_System>();
+    const Mesh_Id sphere_mesh = asset_store.load_mesh_asset("isphere", "icosphere.obj");
+    const Mesh_Id cube_mesh = asset_store.load_mesh_asset("cube", "cube.obj");
+    const Mesh_Id detailed_sphere_mesh = asset_store.load_mesh_asset("isphere_subdivided", "icosphere_subdivided.obj");
+
+    // Inside of the default camera's near and far plane
+    constexpr f32 min_depth = 3.f;
+    constexpr f32 max_depth = 9.f;
+    constexpr f32 scale = 0.35f;
+
+    // View space extent per unit of depth, with a margin so that entities are mostly on screen
+    const Mat4 projection_matrix = reg.get<Camera_System>().get_projection_matrix();
+    const f32 extent_x = 0.8f / projection_matrix[0][0];
+    const f32 extent_y = 0.8f / projection_matrix[1][1];
+
+    // R3 sequence, the index times inverse powers of the generalized golden ratio for three dimensions, modulo 1
+    constexpr std::array<f64, 3> sequence_steps{0.8191725133961645, 0.6710436067037893, 0.5497004779019703};
+    auto sequence = [&](const u32 index, const usize axis) -> f32 {
+        const f64 value = 0.5 + (sequence_steps[axis] * static_cast<f64>(index + 1));
+        return static_cast<f32>(value - std::floor(value));
+    };
+
+    const u32 num_entities = config.num_spheres + config.num_cubes + config.num_detailed_spheres;
+    for (u32 index = 0; index < num_entities; ++index) {
+        const f32 depth = min_depth + ((max_depth - min_depth) * sequence(index, 2));
+
+        const Entity entity = reg.add();
+        const Vec3 translation{
+            ((sequence(index, 0) * 2.f) - 1.f) * extent_x * depth,
+            ((sequence(index, 1) * 2.f) - 1.f) * extent_y * depth,
+            depth,
+        };
+        reg.add(entity, Transform{translation, Vec3::zeroed(), Vec3::splat(scale)});
+        reg.add(entity, Debug_Rotate{});
+
+        // Detailed spheres take the end of the sequence, which is spread over the whole volume just as well. Each one
+        // is orbited by a small sphere parented to it, so that world matrices also go through the hierarchy.
+        if (index >= config.num_spheres + config.num_cubes) {
+            reg.add(entity, detailed_sphere_mesh);
+
+            const Entity moon = reg.add();
+            reg.add(moon, Transform{Vec3{3.f, 0.f, 0.f}, Vec3::zeroed(), Vec3::splat(0.3f)});
+            reg.add(moon, sphere_mesh);
+            reg.get<Transform_System>().set_parent(reg, moon, entity);
+            continue;
+        }
+
+        // Interleaved while both kinds are left, so that both are spread over the whole volume
+        const bool is_sphere = index < 2 * std::min(config.num_spheres, config.num_cubes)
+                             ? index % 2 == 0
+                             : config.num_spheres > config.num_cubes;
+        reg.add(entity, is_sphere ? sphere_mesh : cube_mesh);
+    }
+}
+
+
+// Nearest rank, frame_times_ms has to be sorted
+static f64 percentile(const std::vector<f64>& frame_times_ms, const f64 percent) {
+    const usize rank = static_cast<usize>(std::ceil(percent / 100.0 * static_cast<f64>(frame_times_ms.size())));
+    return frame_times_ms[std::clamp<usize>(rank, 1, frame_times_ms.size()) - 1];
+}
+
+
+static bool run(const Bench_Config& config, Bench_Result& result) {
+    const std::unique_ptr<Registry> reg = std::make_unique<Registry>();
+
+    reg->add<Window_System>();
+    Window_System& window = reg->get<Window_System>();
+    if (!window.init_headless(config.width, config.height)) {
+        return false;
+    }
+
+    reg->add<Time_System>();
+    reg->add<Frame_Arena_System>();
+    reg->add<Render_System>(*reg);
+    reg->add<Tile_Raster_System>(*reg);
+    reg->add<Camera_System>(*reg);
+    reg->add<Asset_Store_System>();
+    reg->add<Transform_System>();
+    reg->add<Bvh_System>(*reg);
+
+    reg->add<Mesh_Render_System>(*reg);
+    reg->add<Debug_Rotate_System>();
+
+    reg->get<Time_System>().set_fixed_delta_seconds(fixed_delta_seconds);
+
+    spawn_scene(*reg, config);
+
+
+    std::vector<f64> frame_times_ms;
+    frame_times_ms.reserve(config.num_frames);
+    u64 num_triangles = 0;
+
+    for (u32 frame_index = 0; frame_index < config.num_warm_up_frames + config.num_frames; ++frame_index) {
+        const auto frame_start = std::chrono::steady_clock::now();
+
+        reg->refresh_systems_entity_sets();
+        reg->get<Frame_Arena_System>().update();
+        reg->get<Time_System>().update();
+        reg->get<Debug_Rotate_System>().update(*reg);
+        reg->get<Transform_System>().update(*reg);
+        reg->get<Bvh_System>().update(*reg);
+        reg->get<Mesh_Render_System>().update(*reg);
+        window.present();
+
+        const auto frame_end = std::chrono::steady_clock::now();
+
+        if (frame_index >= config.num_warm_up_frames) {
+            frame_times_ms.push_back(std::chrono::duration<f64, std::milli>(frame_end - frame_start).count());
+            num_triangles += reg->get<Mesh_Render_System>().get_num_triangles_drawn();
+        }
+    }
+
+
+    const f64 total_ms = std::accumulate(frame_times_ms.begin(), frame_times_ms.end(), 0.0);
+    const f64 total_seconds = total_ms / 1000.0;
+    const f64 num_pixels = static_cast<f64>(config.width) * static_cast<f64>(config.height);
+
+    std::sort(frame_times_ms.begin(), frame_times_ms.end());
+
+    result = Bench_Result{
+        .mean_ms = total_ms / static_cast<f64>(frame_times_ms.size()),
+        .p50_ms = percentile(frame_times_ms, 50.0),
+        .p95_ms = percentile(frame_times_ms, 95.0),
+        .p99_ms = percentile(frame_times_ms, 99.0),
+        .min_ms = frame_times_ms.front(),
+        .max_ms = frame_times_ms.back(),
+        .triangles_per_frame = static_cast<f64>(num_triangles) / static_cast<f64>(frame_times_ms.size()),
+        .triangles_per_second = static_cast<f64>(num_triangles) / total_seconds,
+        .pixels_per_second = num_pixels * static_cast<f64>(frame_times_ms.size()) / total_seconds,
+    };
+    return true;
+}
+
+
+static void write_result(std::ostream& out, const Bench_Config& config, const Bench_Result& result) {
+    if (config.is_json) {
+        out << "{\n"
+            << "    \"spheres\": " << config.num_spheres << ",\n"
+            << "    \"cubes\": " << config.num_cubes << ",\n"
+            << "    \"detailed_spheres\": " << config.num_detailed_spheres << ",\n"
+            << "    \"width\": " << config.width << ",\n"
+            << "    \"height\": " << config.height << ",\n"
+            << "    \"frames\": " << config.num_frames << ",\n"
+            << "    \"mean_ms\": " << result.mean_ms << ",\n"
+            << "    \"p50_ms\": " << result.p50_ms << ",\n"
+            << "    \"p95_ms\": " << result.p95_ms << ",\n"
+            << "    \"p99_ms\": " << result.p99_ms << ",\n"
+            << "    \"min_ms\": " << result.min_ms << ",\n"
+            << "    \"max_ms\": " << result.max_ms << ",\n"
+            << "    \"triangles_per_frame\": " << result.triangles_per_frame << ",\n"
+            << "    \"triangles_per_second\": " << result.triangles_per_second << ",\n"
+            << "    \"pixels_per_second\": " << result.pixels_per_second << "\n"
+            << "}\n";
+        return;
+    }
+
+    out << "spheres,cubes,detailed_spheres,width,height,frames,mean_ms,p50_ms,p95_ms,p99_ms,min_ms,max_ms,"
+        << "triangles_per_frame,triangles_per_second,pixels_per_second\n"
+        << config.num_spheres << ',' << config.num_cubes << ',' << config.num_detailed_spheres << ','
+        << config.width << ',' << config.height << ',' << config.num_frames << ',' << result.mean_ms << ','
+        << result.p50_ms << ',' << result.p95_ms << ',' << result.p99_ms << ',' << result.min_ms << ','
+        << result.max_ms << ',' << result.triangles_per_frame << ',' << result.triangles_per_second << ','
+        << result.pixels_per_second << '\n';
+}
+
+
+i32 main(const i32 argc, char** argv) {
+    Bench_Config config;
+    if (!parse_args(argc, argv, config)) {
+        return EXIT_FAILURE;
+    }
+
+    Bench_Result result;
+    if (!run(config, result)) {
+        ERR("failed to set up a " << config.width << "x" << config.height << " headless window");
+        return EXIT_FAILURE;
+    }
+
+    if (config.output_path.empty()) {
+        write_result(std::cout, config, result);
+        return EXIT_SUCCESS;
+    }
+
+    std::ofstream file{config.output_path};
+    if (file.fail()) {
+        ERR("failed to open " << config.output_path);
+        return EXIT_FAILURE;
+    }
+    write_result(file, config, result);
+
+    return EXIT_SUCCESS;
+}
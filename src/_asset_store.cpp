@@ -1,17 +1,51 @@
 #include "_asset_store.h"
 
 #include "_io.h"
+#include "_meshlet.h"
+#include "_simd.h"
+#include "_simplify.h"
 #include "_tga.h"
 
 #include <filesystem>
 #include <fstream>
+#include <limits>
 
 
 namespace fs = std::filesystem;
 
 
+// Meshes with fewer faces are drawn as they are at any distance
+constexpr usize min_faces_to_simplify = 256;
+
+
 Mesh_View Asset_Store_System::access_mesh_data(const Mesh_Id id) const {
-    return mesh_views[id.id];
+    const Mesh_Range& range = mesh_ranges[id.id];
+
+    Mesh_View mesh_view{
+        .lods = {},
+        .num_lods = range.num_lods,
+        .bounds = range.bounds,
+    };
+
+    for (usize lod_index = 0; lod_index < range.num_lods; ++lod_index) {
+        const Mesh_Lod_Range& lod = range.lods[lod_index];
+        const usize num_stream_elements = simd::padded_to_width(lod.num_vertices);
+
+        mesh_view.lods[lod_index] = Mesh_Lod{
+            .vertices = std::span{vertices}.subspan(lod.vertices_start, lod.num_vertices),
+            .positions = math::Vec3_Streams{
+                .x = std::span{vertex_streams_x}.subspan(lod.streams_start, num_stream_elements),
+                .y = std::span{vertex_streams_y}.subspan(lod.streams_start, num_stream_elements),
+                .z = std::span{vertex_streams_z}.subspan(lod.streams_start, num_stream_elements),
+            },
+            .faces = std::span{faces}.subspan(lod.faces_start, lod.num_faces),
+            .face_normals = std::span{face_normals}.subspan(lod.faces_start, lod.num_faces),
+            .meshlets = std::span{meshlets}.subspan(lod.meshlets_start, lod.num_meshlets),
+            .error = lod.error,
+        };
+    }
+
+    return mesh_view;
 }
 
 
@@ -33,16 +67,82 @@ Mesh_Id Asset_Store_System::load_mesh_asset(const std::string_view unique_mesh_n
     const bool load_success = load_obj_mesh(filename);
     assert(load_success);
 
+    const Bounds bounds = Bounds::from_points(std::span{vertices}.subspan(vertices_start));
+
+
+    // Levels of detail, every level simplifies the previous one to about half of its faces. Each level keeps only the
+    // vertices its faces still use, so that distant meshes don't pay for transforming the full vertex set.
+    //
+    std::array<Mesh_Lod_Range, max_mesh_lods> lods{};
+    lods[0] = add_mesh_lod(vertices_start, faces_start, 0.f);
+    usize num_lods = 1;
+
+    std::vector<Face_Vertex_Indices> simplified_faces;
+    std::vector<u32> simplified_face_origins;
+    std::vector<u32> vertex_remap;
+    std::vector<Vec3> lod_vertices;
+
+    while (num_lods < max_mesh_lods) {
+        const Mesh_Lod_Range previous_lod = lods[num_lods - 1];
+        if (previous_lod.num_faces < min_faces_to_simplify) {
+            break;
+        }
+
+        const f32 error = simplify::simplify(std::span{vertices}.subspan(previous_lod.vertices_start,
+                                                                         previous_lod.num_vertices),
+                                             std::span{faces}.subspan(previous_lod.faces_start, previous_lod.num_faces),
+                                             previous_lod.num_faces / 2,
+                                             simplified_faces,
+                                             simplified_face_origins
+                                             );
+
+        // Not worth a level of its own, the remaining collapses would tear or flip the surface
+        if (simplified_faces.size() > previous_lod.num_faces * 9 / 10) {
+            break;
+        }
+
+
+        // Compact the vertices that are still in use
+        constexpr u32 unused_vertex = std::numeric_limits<u32>::max();
+        vertex_remap.assign(previous_lod.num_vertices, unused_vertex);
+        lod_vertices.clear();
+
+        for (Face_Vertex_Indices& face : simplified_faces) {
+            for (u16& vertex_index : face) {
+                if (vertex_remap[vertex_index] == unused_vertex) {
+                    vertex_remap[vertex_index] = static_cast<u32>(lod_vertices.size());
+                    lod_vertices.push_back(vertices[previous_lod.vertices_start + vertex_index]);
+                }
+                vertex_index = static_cast<u16>(vertex_remap[vertex_index]);
+            }
+        }
+
+        const usize lod_vertices_start = vertices.size();
+        const usize lod_faces_start = faces.size();
+        vertices.insert(vertices.end(), lod_vertices.begin(), lod_vertices.end());
+        faces.insert(faces.end(), simplified_faces.begin(), simplified_faces.end());
+
+        faces_uv_indices.reserve(faces.size());
+        for (const u32 origin : simplified_face_origins) {
+            faces_uv_indices.push_back(faces_uv_indices[previous_lod.faces_start + origin]);
+        }
+
+        // The error is measured against the previous level, summing it bounds the error against the full mesh
+        lods[num_lods] = add_mesh_lod(lod_vertices_start, lod_faces_start, previous_lod.error + error);
+        ++num_lods;
+    }
+
 
     mesh_names.emplace_back() = unique_mesh_name;
 
-    mesh_views.emplace_back() = Mesh_View{
-        .vertices = std::span{&vertices[vertices_start], vertices.size() - vertices_start},
-        .faces = std::span{&faces[faces_start], faces.size() - faces_start},
+    mesh_ranges.emplace_back() = Mesh_Range{
+        .lods = lods,
+        .num_lods = num_lods,
+        .bounds = bounds,
     };
 
     const Mesh_Id mesh_id{
-        .id = mesh_views.size() - 1,
+        .id = mesh_ranges.size() - 1,
     };
 
     return mesh_id;
@@ -102,6 +202,87 @@ Texture_Id Asset_Store_System::get_texture_id(const std::string_view unique_text
 }
 
 
+// Finishes the level of detail made of the vertices from vertices_start and the faces from faces_start to the end of
+// their storage. The faces must already have their uv indices.
+Asset_Store_System::Mesh_Lod_Range Asset_Store_System::add_mesh_lod(const usize vertices_start,
+                                                                    const usize faces_start,
+                                                                    const f32 error) {
+    assert(faces_uv_indices.size() == faces.size());
+    assert(face_normals.size() == faces_start);
+
+    const usize num_vertices = vertices.size() - vertices_start;
+    const usize num_faces = faces.size() - faces_start;
+    const std::span<const Vec3> mesh_vertices = std::span{vertices}.subspan(vertices_start);
+
+
+    // Face normals for lighting and culling, so they don't have to be derived from transformed corners every frame
+    face_normals.reserve(faces.size());
+    for (usize face_index = faces_start; face_index < faces.size(); ++face_index) {
+        const Vec3& a = mesh_vertices[faces[face_index][0]];
+        const Vec3& b = mesh_vertices[faces[face_index][1]];
+        const Vec3& c = mesh_vertices[faces[face_index][2]];
+
+        face_normals.emplace_back() = math::cross(b - a, c - a);
+    }
+
+
+    // Meshlets, the faces are reordered so that every meshlet covers a contiguous range of them
+    //
+    const usize meshlets_start = meshlets.size();
+    {
+        std::vector<Meshlet> mesh_meshlets;
+        std::vector<u32> face_order;
+        meshlet::build(mesh_vertices,
+                       std::span{faces}.subspan(faces_start),
+                       std::span{face_normals}.subspan(faces_start),
+                       mesh_meshlets,
+                       face_order
+                       );
+
+        const std::vector<Face_Vertex_Indices> unordered_faces(faces.begin() + faces_start, faces.end());
+        const std::vector<Face_UV_Indices> unordered_faces_uv_indices(faces_uv_indices.begin() + faces_start,
+                                                                      faces_uv_indices.end());
+        const std::vector<Vec3> unordered_face_normals(face_normals.begin() + faces_start, face_normals.end());
+
+        for (usize face_index = 0; face_index < num_faces; ++face_index) {
+            faces[faces_start + face_index] = unordered_faces[face_order[face_index]];
+            faces_uv_indices[faces_start + face_index] = unordered_faces_uv_indices[face_order[face_index]];
+            face_normals[faces_start + face_index] = unordered_face_normals[face_order[face_index]];
+        }
+
+        meshlets.insert(meshlets.end(), mesh_meshlets.begin(), mesh_meshlets.end());
+    }
+
+
+    // Structure of arrays copy of the positions, padded with zeroes to a whole number of SIMD registers
+    const usize streams_start = vertex_streams_x.size();
+    const usize num_stream_elements = simd::padded_to_width(num_vertices);
+
+    vertex_streams_x.resize(streams_start + num_stream_elements, 0.f);
+    vertex_streams_y.resize(streams_start + num_stream_elements, 0.f);
+    vertex_streams_z.resize(streams_start + num_stream_elements, 0.f);
+
+    for (usize vertex_index = 0; vertex_index < num_vertices; ++vertex_index) {
+        const Vec3& vertex = mesh_vertices[vertex_index];
+
+        vertex_streams_x[streams_start + vertex_index] = vertex.x;
+        vertex_streams_y[streams_start + vertex_index] = vertex.y;
+        vertex_streams_z[streams_start + vertex_index] = vertex.z;
+    }
+
+    return Mesh_Lod_Range{
+        .vertices_start = vertices_start,
+        .num_vertices = num_vertices,
+        .streams_start = streams_start,
+        .faces_start = faces_start,
+        .num_faces = num_faces,
+        .meshlets_start = meshlets_start,
+        .num_meshlets = meshlets.size() - meshlets_start,
+        .error = error,
+    };
+}
+
+
 bool Asset_Store_System::load_obj_mesh(const std::string_view filename) {
     if (filename.empty()) {
         ERR("filename nullptr");
@@ -188,26 +369,15 @@ bool Asset_Store_System::load_tga_texture(const std::string_view filename, Vec2i
     assert(header.get_color_map_type() != tga::Color_Map_Type::Present);
     assert(header.image.bits_per_pixel == 24 || header.image.bits_per_pixel == 32);
 
-    const usize bytes_per_pixel = header.image.bits_per_pixel / 8;
-    const usize num_pixels = header.num_pixels();
-
     // TODO:
     assert(header.is_positive_x_right());
     assert(header.is_positive_y_down());
 
 
     const usize texture_pixels_start = texture_pixels.size();
-    texture_pixels.resize(texture_pixels.size() + num_pixels, Color::black());
-
+    texture_pixels.resize(texture_pixels.size() + header.num_pixels());
 
-    const std::span<u8> src = {&tga_data[header.offset_image()], header.packed_byte_size_image()};
-    const std::span<u8> dst = {reinterpret_cast<u8*>(&texture_pixels[texture_pixels_start]), sizeof(Color) * header.num_pixels()};
-
-    for (usize px_idx = 0; px_idx < num_pixels; ++px_idx) {
-        for (usize offset = 0; offset < bytes_per_pixel; ++offset) {
-            dst[(px_idx * sizeof(Color)) + offset] = src[(px_idx * bytes_per_pixel) + offset];
-        }
-    }
+    tga::decode_pixels(header, tga_data, std::span{texture_pixels}.subspan(texture_pixels_start));
 
     dimensions.width = header.image.pixel_width;
     dimensions.height = header.image.pixel_height;
@@ -0,0 +1,282 @@
+#include "_bounds.h"
+#include "_simd.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+// =====================================================================================================================
+// == Bounding_Box =====================================================================================================
+// =====================================================================================================================
+
+Bounding_Box Bounding_Box::from_points(const std::span<const Vec3> points) {
+    assert(!points.empty());
+
+    Bounding_Box box{points[0], points[0]};
+
+    for (const Vec3& point : points) {
+        for (usize axis = 0; axis < 3; ++axis) {
+            box.min[axis] = std::min(box.min[axis], point[axis]);
+            box.max[axis] = std::max(box.max[axis], point[axis]);
+        }
+    }
+
+    return box;
+}
+
+
+Bounding_Box Bounding_Box::merged(const Bounding_Box& a, const Bounding_Box& b) {
+    Bounding_Box box;
+    for (usize axis = 0; axis < 3; ++axis) {
+        box.min[axis] = std::min(a.min[axis], b.min[axis]);
+        box.max[axis] = std::max(a.max[axis], b.max[axis]);
+    }
+    return box;
+}
+
+
+Vec3 Bounding_Box::center() const {
+    return (min + max) * 0.5f;
+}
+
+
+Vec3 Bounding_Box::half_extents() const {
+    return (max - min) * 0.5f;
+}
+
+
+f32 Bounding_Box::surface_area() const {
+    const Vec3 size = max - min;
+    return 2.f * ((size.x * size.y) + (size.y * size.z) + (size.z * size.x));
+}
+
+
+bool Bounding_Box::contains(const Bounding_Box& other) const {
+    return min.x <= other.min.x && min.y <= other.min.y && min.z <= other.min.z &&
+           max.x >= other.max.x && max.y >= other.max.y && max.z >= other.max.z;
+}
+
+
+bool Bounding_Box::contains(const Vec3 point) const {
+    return min.x <= point.x && min.y <= point.y && min.z <= point.z &&
+           max.x >= point.x && max.y >= point.y && max.z >= point.z;
+}
+
+
+Bounding_Box Bounding_Box::expanded(const f32 margin) const {
+    return Bounding_Box{min - Vec3::splat(margin), max + Vec3::splat(margin)};
+}
+
+
+Bounding_Box Bounding_Box::transformed(const Mat4& mat) const {
+    // Transform the center, then project the extents onto each axis with the absolute matrix
+    const Vec3 old_center = center();
+    const Vec3 old_half_extents = half_extents();
+
+    const Vec3 new_center = Vec3::from_vec4(mat * Vec4::from_vec3(old_center, 1.f));
+
+    Vec3 new_half_extents;
+    for (usize row = 0; row < 3; ++row) {
+        new_half_extents[row] = std::abs(mat[row][0]) * old_half_extents.x +
+                                std::abs(mat[row][1]) * old_half_extents.y +
+                                std::abs(mat[row][2]) * old_half_extents.z;
+    }
+
+    return Bounding_Box{new_center - new_half_extents, new_center + new_half_extents};
+}
+
+
+// =====================================================================================================================
+// == Bounding_Sphere ==================================================================================================
+// =====================================================================================================================
+
+Bounding_Sphere Bounding_Sphere::from_points(const std::span<const Vec3> points) {
+    const Vec3 center = Bounding_Box::from_points(points).center();
+
+    f32 sq_radius = 0.f;
+    for (const Vec3& point : points) {
+        sq_radius = std::max(sq_radius, math::sq_magnitude(point - center));
+    }
+
+    return Bounding_Sphere{center, std::sqrt(sq_radius)};
+}
+
+
+Bounding_Sphere Bounding_Sphere::transformed(const Mat4& mat) const {
+    const Vec3 new_center = Vec3::from_vec4(mat * Vec4::from_vec3(center, 1.f));
+
+    return Bounding_Sphere{new_center, radius * Mat4::max_axis_scale(mat)};
+}
+
+
+void Bounding_Sphere::transformed(const std::span<const Mat4> matrices, const Bounding_Sphere_Streams spheres) const {
+    const usize num_spheres = matrices.size();
+    assert(spheres.center_x.size() == num_spheres && spheres.center_y.size() == num_spheres &&
+           spheres.center_z.size() == num_spheres && spheres.radius.size() == num_spheres);
+
+    usize sphere_index = 0;
+
+    for (; sphere_index + simd::width <= num_spheres; sphere_index += simd::width) {
+        // Transpose the upper 3x4 of simd::width matrices, one lane per matrix
+        alignas(32) std::array<std::array<f32, simd::width>, 12> elements;
+        for (usize lane = 0; lane < simd::width; ++lane) {
+            const Mat4& mat = matrices[sphere_index + lane];
+            for (usize row = 0; row < 3; ++row) {
+                for (usize column = 0; column < 4; ++column) {
+                    elements[(row * 4) + column][lane] = mat[row][column];
+                }
+            }
+        }
+
+        simd::F32_Lanes m[12];
+        for (usize element = 0; element < 12; ++element) {
+            m[element] = simd::load(elements[element].data());
+        }
+
+        const simd::F32_Lanes x = simd::splat(center.x);
+        const simd::F32_Lanes y = simd::splat(center.y);
+        const simd::F32_Lanes z = simd::splat(center.z);
+
+        simd::store(&spheres.center_x[sphere_index], m[0] * x + m[1] * y + m[2] * z + m[3]);
+        simd::store(&spheres.center_y[sphere_index], m[4] * x + m[5] * y + m[6] * z + m[7]);
+        simd::store(&spheres.center_z[sphere_index], m[8] * x + m[9] * y + m[10] * z + m[11]);
+
+        // Largest squared basis vector (column) length
+        simd::F32_Lanes max_sq_scale = simd::splat(0.f);
+        for (usize column = 0; column < 3; ++column) {
+            max_sq_scale = simd::max(max_sq_scale, m[column] * m[column] +
+                                                   m[4 + column] * m[4 + column] +
+                                                   m[8 + column] * m[8 + column]);
+        }
+        simd::store(&spheres.radius[sphere_index], simd::splat(radius) * simd::sqrt(max_sq_scale));
+    }
+
+    // Remainder
+    for (; sphere_index < num_spheres; ++sphere_index) {
+        const Bounding_Sphere sphere = transformed(matrices[sphere_index]);
+
+        spheres.center_x[sphere_index] = sphere.center.x;
+        spheres.center_y[sphere_index] = sphere.center.y;
+        spheres.center_z[sphere_index] = sphere.center.z;
+        spheres.radius[sphere_index] = sphere.radius;
+    }
+}
+
+
+// =====================================================================================================================
+// == Bounds ===========================================================================================================
+// =====================================================================================================================
+
+Bounds Bounds::from_points(const std::span<const Vec3> points) {
+    return Bounds{
+        .box = Bounding_Box::from_points(points),
+        .sphere = Bounding_Sphere::from_points(points),
+    };
+}
+
+
+// =====================================================================================================================
+// == Plane ============================================================================================================
+// =====================================================================================================================
+
+f32 Plane::signed_distance(const Vec3 point) const {
+    return math::dot(normal, point) + distance;
+}
+
+
+// =====================================================================================================================
+// == Frustum ==========================================================================================================
+// =====================================================================================================================
+
+Frustum Frustum::from_view_projection(const Mat4& view_projection) {
+    // Gribb/Hartmann: each clip space inequality, e.g. -w <= x, is a plane equation over the rows of the matrix
+    const Vec4& row_x = view_projection[0];
+    const Vec4& row_y = view_projection[1];
+    const Vec4& row_z = view_projection[2];
+    const Vec4& row_w = view_projection[3];
+
+    std::array<Vec4, Count> plane_equations;
+    plane_equations[Left] = row_w + row_x;
+    plane_equations[Right] = row_w - row_x;
+    plane_equations[Bottom] = row_w + row_y;
+    plane_equations[Top] = row_w - row_y;
+    plane_equations[Near] = row_z;
+    plane_equations[Far] = row_w - row_z;
+
+    Frustum frustum;
+    for (usize side = 0; side < Count; ++side) {
+        const Vec4& equation = plane_equations[side];
+        const Vec3 normal = Vec3::from_vec4(equation);
+
+        // Normalized so that signed distances are in world units, which sphere tests rely on
+        const f32 inverse_length = 1.f / math::magnitude(normal);
+
+        frustum.planes[side] = Plane{normal * inverse_length, equation.w * inverse_length};
+    }
+
+    return frustum;
+}
+
+
+bool Frustum::is_outside(const Bounding_Sphere& sphere) const {
+    for (const Plane& plane : planes) {
+        if (plane.signed_distance(sphere.center) < -sphere.radius) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+bool Frustum::is_outside(const Bounding_Box& box) const {
+    for (const Plane& plane : planes) {
+        // Corner furthest along the plane normal
+        const Vec3 positive_corner{
+            plane.normal.x >= 0.f ? box.max.x : box.min.x,
+            plane.normal.y >= 0.f ? box.max.y : box.min.y,
+            plane.normal.z >= 0.f ? box.max.z : box.min.z,
+        };
+
+        if (plane.signed_distance(positive_corner) < 0.f) {
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void Frustum::are_outside(const Bounding_Sphere_Streams spheres, const std::span<u32> is_outside_flags) const {
+    const usize num_spheres = is_outside_flags.size();
+    assert(spheres.center_x.size() == num_spheres && spheres.center_y.size() == num_spheres &&
+           spheres.center_z.size() == num_spheres && spheres.radius.size() == num_spheres);
+
+    usize sphere_index = 0;
+
+    for (; sphere_index + simd::width <= num_spheres; sphere_index += simd::width) {
+        const simd::F32_Lanes x = simd::load(&spheres.center_x[sphere_index]);
+        const simd::F32_Lanes y = simd::load(&spheres.center_y[sphere_index]);
+        const simd::F32_Lanes z = simd::load(&spheres.center_z[sphere_index]);
+        const simd::F32_Lanes negative_radius = simd::splat(0.f) - simd::load(&spheres.radius[sphere_index]);
+
+        simd::Mask is_outside{};   // no lanes set
+        for (const Plane& plane : planes) {
+            const simd::F32_Lanes signed_distance = simd::splat(plane.normal.x) * x +
+                                                    simd::splat(plane.normal.y) * y +
+                                                    simd::splat(plane.normal.z) * z +
+                                                    simd::splat(plane.distance);
+
+            is_outside = is_outside | simd::less_than(signed_distance, negative_radius);
+        }
+
+        simd::store(&is_outside_flags[sphere_index], simd::select(is_outside, simd::splat(1), simd::splat(0)));
+    }
+
+    // Remainder
+    for (; sphere_index < num_spheres; ++sphere_index) {
+        const Bounding_Sphere sphere{
+            Vec3{spheres.center_x[sphere_index], spheres.center_y[sphere_index], spheres.center_z[sphere_index]},
+            spheres.radius[sphere_index],
+        };
+        is_outside_flags[sphere_index] = is_outside(sphere);
+    }
+}
@@ -0,0 +1,460 @@
+#include "_bvh.h"
+
+#include "_asset_store.h"
+
+#include <algorithm>
+#include <cassert>
+
+
+// How much leaf boxes are grown, in world units. Larger margins mean fewer reinserts for moving entities but looser
+// culling.
+constexpr f32 fat_box_margin = 0.1f;
+
+
+// =====================================================================================================================
+// == Bvh ==============================================================================================================
+// =====================================================================================================================
+
+i32 Bvh::insert(const Bounding_Box& box, const usize user_data) {
+    const i32 leaf = allocate_node();
+
+    nodes[leaf].box = box.expanded(fat_box_margin);
+    nodes[leaf].user_data = user_data;
+    nodes[leaf].height = 0;
+
+    insert_leaf(leaf);
+    return leaf;
+}
+
+
+void Bvh::remove(const i32 leaf) {
+    assert(leaf >= 0 && leaf < static_cast<i32>(nodes.size()) && nodes[leaf].is_leaf());
+
+    remove_leaf(leaf);
+    free_node(leaf);
+}
+
+
+bool Bvh::move(const i32 leaf, const Bounding_Box& box) {
+    assert(leaf >= 0 && leaf < static_cast<i32>(nodes.size()) && nodes[leaf].is_leaf());
+
+    if (nodes[leaf].box.contains(box)) {
+        return false;
+    }
+
+    remove_leaf(leaf);
+    nodes[leaf].box = box.expanded(fat_box_margin);
+    insert_leaf(leaf);
+    return true;
+}
+
+
+usize Bvh::get_user_data(const i32 leaf) const {
+    return nodes[leaf].user_data;
+}
+
+
+const Bounding_Box& Bvh::get_fat_box(const i32 leaf) const {
+    return nodes[leaf].box;
+}
+
+
+i32 Bvh::get_height() const {
+    return root == null_node ? 0 : nodes[root].height;
+}
+
+
+void Bvh::query(const Frustum& frustum, std::vector<usize>& results) const {
+    if (root == null_node) {
+        return;
+    }
+
+    // Every node carries a bit per frustum plane it still straddles. Once a node is fully inside all planes, its whole
+    // subtree is visible without further tests.
+    constexpr u32 all_planes_mask = (1u << Frustum::Count) - 1;
+
+    frustum_stack.clear();
+    frustum_stack.push_back(Frustum_Stack_Entry{root, all_planes_mask});
+
+    while (!frustum_stack.empty()) {
+        const Frustum_Stack_Entry entry = frustum_stack.back();
+        frustum_stack.pop_back();
+
+        const Node& node = nodes[entry.node];
+
+        u32 plane_mask = entry.plane_mask;
+        bool is_outside = false;
+
+        for (usize side = 0; side < Frustum::Count && plane_mask != 0; ++side) {
+            if ((plane_mask & (1u << side)) == 0) {
+                continue;
+            }
+
+            const Plane& plane = frustum.planes[side];
+
+            // Corners furthest along and against the plane normal
+            const Vec3 positive_corner{
+                plane.normal.x >= 0.f ? node.box.max.x : node.box.min.x,
+                plane.normal.y >= 0.f ? node.box.max.y : node.box.min.y,
+                plane.normal.z >= 0.f ? node.box.max.z : node.box.min.z,
+            };
+            const Vec3 negative_corner{
+                plane.normal.x >= 0.f ? node.box.min.x : node.box.max.x,
+                plane.normal.y >= 0.f ? node.box.min.y : node.box.max.y,
+                plane.normal.z >= 0.f ? node.box.min.z : node.box.max.z,
+            };
+
+            if (plane.signed_distance(positive_corner) < 0.f) {
+                is_outside = true;
+                break;
+            }
+            if (plane.signed_distance(negative_corner) >= 0.f) {
+                plane_mask &= ~(1u << side);
+            }
+        }
+
+        if (is_outside) {
+            continue;
+        }
+
+        if (node.is_leaf()) {
+            results.push_back(node.user_data);
+            continue;
+        }
+
+        frustum_stack.push_back(Frustum_Stack_Entry{node.children[0], plane_mask});
+        frustum_stack.push_back(Frustum_Stack_Entry{node.children[1], plane_mask});
+    }
+}
+
+
+void Bvh::query(const Vec3 point, std::vector<usize>& results) const {
+    if (root == null_node) {
+        return;
+    }
+
+    node_stack.clear();
+    node_stack.push_back(root);
+
+    while (!node_stack.empty()) {
+        const Node& node = nodes[node_stack.back()];
+        node_stack.pop_back();
+
+        if (!node.box.contains(point)) {
+            continue;
+        }
+
+        if (node.is_leaf()) {
+            results.push_back(node.user_data);
+            continue;
+        }
+
+        node_stack.push_back(node.children[0]);
+        node_stack.push_back(node.children[1]);
+    }
+}
+
+
+void Bvh::query_ray(const Vec3 origin, const Vec3 direction, const f32 max_distance,
+                    std::vector<usize>& results) const {
+    if (root == null_node) {
+        return;
+    }
+
+    const Vec3 inverse_direction{1.f / direction.x, 1.f / direction.y, 1.f / direction.z};
+
+    // Slab test, in units of direction
+    auto is_box_hit = [&](const Bounding_Box& box) -> bool {
+        f32 t_min = 0.f;
+        f32 t_max = max_distance;
+
+        for (usize axis = 0; axis < 3; ++axis) {
+            f32 t_near = (box.min[axis] - origin[axis]) * inverse_direction[axis];
+            f32 t_far = (box.max[axis] - origin[axis]) * inverse_direction[axis];
+            if (t_near > t_far) {
+                std::swap(t_near, t_far);
+            }
+
+            t_min = std::max(t_min, t_near);
+            t_max = std::min(t_max, t_far);
+            if (t_min > t_max) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    node_stack.clear();
+    node_stack.push_back(root);
+
+    while (!node_stack.empty()) {
+        const Node& node = nodes[node_stack.back()];
+        node_stack.pop_back();
+
+        if (!is_box_hit(node.box)) {
+            continue;
+        }
+
+        if (node.is_leaf()) {
+            results.push_back(node.user_data);
+            continue;
+        }
+
+        node_stack.push_back(node.children[0]);
+        node_stack.push_back(node.children[1]);
+    }
+}
+
+
+i32 Bvh::allocate_node() {
+    if (free_list == null_node) {
+        nodes.emplace_back();
+        free_list = static_cast<i32>(nodes.size()) - 1;
+        nodes[free_list].parent = null_node;
+    }
+
+    const i32 node = free_list;
+    free_list = nodes[node].parent;
+
+    nodes[node].parent = null_node;
+    nodes[node].children[0] = null_node;
+    nodes[node].children[1] = null_node;
+    nodes[node].height = 0;
+    return node;
+}
+
+
+void Bvh::free_node(const i32 node) {
+    nodes[node].parent = free_list;
+    nodes[node].height = -1;
+    free_list = node;
+}
+
+
+void Bvh::insert_leaf(const i32 leaf) {
+    if (root == null_node) {
+        root = leaf;
+        nodes[leaf].parent = null_node;
+        return;
+    }
+
+    // Descend towards the cheapest sibling. Pairing the leaf with a node costs the surface area of their union, and
+    // every ancestor grows by the same amount (the inheritance cost).
+    const Bounding_Box leaf_box = nodes[leaf].box;
+
+    i32 index = root;
+    while (!nodes[index].is_leaf()) {
+        const Node& node = nodes[index];
+
+        const f32 area = node.box.surface_area();
+        const f32 combined_area = Bounding_Box::merged(node.box, leaf_box).surface_area();
+
+        const f32 cost_here = 2.f * combined_area;
+        const f32 inheritance_cost = 2.f * (combined_area - area);
+
+        f32 child_costs[2];
+        for (usize child_index = 0; child_index < 2; ++child_index) {
+            const Node& child = nodes[node.children[child_index]];
+            const f32 merged_area = Bounding_Box::merged(child.box, leaf_box).surface_area();
+
+            child_costs[child_index] = inheritance_cost +
+                                       (child.is_leaf() ? merged_area : merged_area - child.box.surface_area());
+        }
+
+        if (cost_here < child_costs[0] && cost_here < child_costs[1]) {
+            break;
+        }
+
+        index = child_costs[0] < child_costs[1] ? node.children[0] : node.children[1];
+    }
+
+    const i32 sibling = index;
+
+
+    // New parent for the sibling and the leaf
+    const i32 old_parent = nodes[sibling].parent;
+    const i32 new_parent = allocate_node();
+
+    nodes[new_parent].parent = old_parent;
+    nodes[new_parent].box = Bounding_Box::merged(leaf_box, nodes[sibling].box);
+    nodes[new_parent].height = nodes[sibling].height + 1;
+    nodes[new_parent].children[0] = sibling;
+    nodes[new_parent].children[1] = leaf;
+
+    nodes[sibling].parent = new_parent;
+    nodes[leaf].parent = new_parent;
+
+    if (old_parent == null_node) {
+        root = new_parent;
+    } else {
+        i32* old_parent_children = nodes[old_parent].children;
+        old_parent_children[old_parent_children[0] == sibling ? 0 : 1] = new_parent;
+    }
+
+    refit_ancestors(nodes[leaf].parent);
+}
+
+
+void Bvh::remove_leaf(const i32 leaf) {
+    if (leaf == root) {
+        root = null_node;
+        return;
+    }
+
+    const i32 parent = nodes[leaf].parent;
+    const i32 grandparent = nodes[parent].parent;
+    const i32 sibling = nodes[parent].children[0] == leaf ? nodes[parent].children[1] : nodes[parent].children[0];
+
+    // The sibling takes the place of the parent
+    if (grandparent == null_node) {
+        root = sibling;
+        nodes[sibling].parent = null_node;
+        free_node(parent);
+        return;
+    }
+
+    i32* grandparent_children = nodes[grandparent].children;
+    grandparent_children[grandparent_children[0] == parent ? 0 : 1] = sibling;
+    nodes[sibling].parent = grandparent;
+    free_node(parent);
+
+    refit_ancestors(grandparent);
+}
+
+
+void Bvh::refit_ancestors(i32 node) {
+    while (node != null_node) {
+        node = balance(node);
+
+        const Node& child_a = nodes[nodes[node].children[0]];
+        const Node& child_b = nodes[nodes[node].children[1]];
+
+        nodes[node].height = 1 + std::max(child_a.height, child_b.height);
+        nodes[node].box = Bounding_Box::merged(child_a.box, child_b.box);
+
+        node = nodes[node].parent;
+    }
+}
+
+
+i32 Bvh::balance(const i32 index_a) {
+    // Rotates the taller grandchild up when the children of a differ in height by more than one. Returns the node now
+    // in a's place.
+    Node& a = nodes[index_a];
+    if (a.is_leaf() || a.height < 2) {
+        return index_a;
+    }
+
+    const i32 index_b = a.children[0];
+    const i32 index_c = a.children[1];
+    Node& b = nodes[index_b];
+    Node& c = nodes[index_c];
+
+    const i32 height_difference = c.height - b.height;
+    if (height_difference >= -1 && height_difference <= 1) {
+        return index_a;
+    }
+
+    // The taller child moves up, its shorter child moves down to a
+    const bool is_c_up = height_difference > 1;
+
+    const i32 index_up = is_c_up ? index_c : index_b;
+    const i32 index_stay = is_c_up ? index_b : index_c;
+    Node& up = nodes[index_up];
+    const Node& stay = nodes[index_stay];
+
+    // Swap a and up
+    up.parent = a.parent;
+    a.parent = index_up;
+
+    if (up.parent == null_node) {
+        root = index_up;
+    } else {
+        i32* parent_children = nodes[up.parent].children;
+        parent_children[parent_children[0] == index_a ? 0 : 1] = index_up;
+    }
+
+    const i32 index_f = up.children[0];
+    const i32 index_g = up.children[1];
+    Node& f = nodes[index_f];
+    Node& g = nodes[index_g];
+
+    const i32 index_taller = f.height > g.height ? index_f : index_g;
+    const i32 index_shorter = f.height > g.height ? index_g : index_f;
+    Node& shorter = nodes[index_shorter];
+    const Node& taller = nodes[index_taller];
+
+    // up keeps its taller child and adopts a, a keeps the other child and adopts up's shorter child
+    up.children[0] = index_a;
+    up.children[1] = index_taller;
+
+    a.children[0] = index_stay;
+    a.children[1] = index_shorter;
+    shorter.parent = index_a;
+
+    a.box = Bounding_Box::merged(stay.box, shorter.box);
+    a.height = 1 + std::max(stay.height, shorter.height);
+
+    up.box = Bounding_Box::merged(a.box, taller.box);
+    up.height = 1 + std::max(a.height, taller.height);
+
+    return index_up;
+}
+
+
+// =====================================================================================================================
+// == Bvh_System =======================================================================================================
+// =====================================================================================================================
+
+Bvh_System::Bvh_System(Registry& reg)
+    : asset_store(reg.get<Asset_Store_System>()) {
+
+    require_component<Transform>();
+    require_component<Mesh_Id>();
+}
+
+
+void Bvh_System::update(Registry& reg) {
+    for (const Entity entity : get_entities()) {
+        if (entity >= entity_leaves.size()) {
+            entity_leaves.resize(entity + 1);
+        }
+
+        Entity_Leaf& entity_leaf = entity_leaves[entity];
+        const Transform& transform = reg.get<Transform>(entity);
+
+        const bool is_new = entity_leaf.leaf == Bvh::null_node;
+        const bool has_moved = entity_leaf.world_matrix_version != transform.get_world_matrix_version();
+
+        if (!is_new && !has_moved) {
+            continue;
+        }
+
+        entity_leaf.world_matrix_version = transform.get_world_matrix_version();
+
+        const Mesh_View mesh = asset_store.access_mesh_data(reg.get<Mesh_Id>(entity));
+        const Bounding_Box world_box = mesh.bounds.box.transformed(transform.get_world_matrix());
+
+        if (is_new) {
+            entity_leaf.leaf = tree.insert(world_box, entity);
+        } else {
+            tree.move(entity_leaf.leaf, world_box);
+        }
+    }
+}
+
+
+void Bvh_System::query_visible(const Frustum& frustum, std::vector<Entity>& entities) const {
+    tree.query(frustum, entities);
+}
+
+
+void Bvh_System::query_point(const Vec3 point, std::vector<Entity>& entities) const {
+    tree.query(point, entities);
+}
+
+
+void Bvh_System::query_ray(const Vec3 origin, const Vec3 direction, const f32 max_distance,
+                           std::vector<Entity>& entities) const {
+    tree.query_ray(origin, direction, max_distance, entities);
+}
@@ -4,6 +4,8 @@
 Camera_System::Camera_System(Registry& registry)
     : window(registry.get<Window_System>()),
       position(Vec3::zeroed()),
+      yaw(0.f),
+      pitch(0.f),
       fov(math::to_radians(60.f)),
       aspect_ratio(0.f),
       z_near(0.1f),
@@ -16,6 +18,17 @@ void Camera_System::set_fov(const f32 fov_deg) {
 }
 
 
+void Camera_System::set_position(const Vec3 new_position) {
+    position = new_position;
+}
+
+
+void Camera_System::set_rotation(const f32 yaw_rad, const f32 pitch_rad) {
+    yaw = yaw_rad;
+    pitch = pitch_rad;
+}
+
+
 Mat4 Camera_System::get_projection_matrix() const {
     const f32 aspect_ratio = static_cast<f32>(window.height) / static_cast<f32>(window.width);
     return Mat4::perspective_projection(fov, aspect_ratio, z_near, z_far);
@@ -25,3 +38,22 @@ Mat4 Camera_System::get_projection_matrix() const {
 Vec3 Camera_System::get_position() const {
     return position;
 }
+
+
+Mat4 Camera_System::get_view_matrix() const {
+    // Inverse of the camera transform translation * rot_y(yaw) * rot_x(pitch). Rotations are orthonormal, so they
+    // are inverted by negating the angle.
+    return Mat4::rot_x(-pitch) *
+           Mat4::rot_y(-yaw) *
+           Mat4::translation(-position);
+}
+
+
+Mat4 Camera_System::get_view_projection_matrix() const {
+    return get_projection_matrix() * get_view_matrix();
+}
+
+
+Frustum Camera_System::get_frustum() const {
+    return Frustum::from_view_projection(get_view_projection_matrix());
+}
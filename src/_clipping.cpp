@@ -0,0 +1,108 @@
+#include "_clipping.h"
+
+
+namespace clipping {
+
+
+// Plane in clip space, a point is inside when dot(plane, point) >= 0
+enum class Plane : u8 {
+    Near,
+    Far,
+    Left,
+    Right,
+    Bottom,
+    Top,
+    Count,
+};
+
+
+static f32 plane_distance(const Plane plane, const Vec4 point, const Vec2 guard_band) {
+    switch (plane) {
+        case Plane::Near:   return point.z;
+        case Plane::Far:    return point.w - point.z;
+        case Plane::Left:   return point.x + (guard_band.x * point.w);
+        case Plane::Right:  return (guard_band.x * point.w) - point.x;
+        case Plane::Bottom: return point.y + (guard_band.y * point.w);
+        case Plane::Top:    return (guard_band.y * point.w) - point.y;
+        default:            return 0.f;
+    }
+}
+
+
+Polygon Polygon::from_triangle(const std::array<Vec4, 3>& corners) {
+    Polygon polygon;
+    polygon.vertices[0] = corners[0];
+    polygon.vertices[1] = corners[1];
+    polygon.vertices[2] = corners[2];
+    polygon.num_vertices = 3;
+    return polygon;
+}
+
+
+Triangle_Clip_Result classify_triangle(const std::array<Vec4, 3>& corners, const Vec2 guard_band) {
+    // Trivial reject uses the real view volume, anything outside of it is invisible
+    for (u8 plane_index = 0; plane_index < static_cast<u8>(Plane::Count); ++plane_index) {
+        const Plane plane = static_cast<Plane>(plane_index);
+
+        if (plane_distance(plane, corners[0], Vec2::splat(1.f)) < 0.f &&
+            plane_distance(plane, corners[1], Vec2::splat(1.f)) < 0.f &&
+            plane_distance(plane, corners[2], Vec2::splat(1.f)) < 0.f) {
+            return Triangle_Clip_Result::Outside;
+        }
+    }
+
+    for (u8 plane_index = 0; plane_index < static_cast<u8>(Plane::Count); ++plane_index) {
+        const Plane plane = static_cast<Plane>(plane_index);
+
+        for (const Vec4& corner : corners) {
+            if (plane_distance(plane, corner, guard_band) < 0.f) {
+                return Triangle_Clip_Result::Needs_Clipping;
+            }
+        }
+    }
+
+    return Triangle_Clip_Result::Inside;
+}
+
+
+void clip_polygon(Polygon& polygon, const Vec2 guard_band) {
+    // Sutherland-Hodgman, one plane at a time
+    for (u8 plane_index = 0; plane_index < static_cast<u8>(Plane::Count); ++plane_index) {
+        if (polygon.num_vertices < 3) {
+            polygon.num_vertices = 0;
+            return;
+        }
+
+        const Plane plane = static_cast<Plane>(plane_index);
+        const Polygon input = polygon;
+        polygon.num_vertices = 0;
+
+        Vec4 previous = input.vertices[input.num_vertices - 1];
+        f32 previous_distance = plane_distance(plane, previous, guard_band);
+
+        for (usize vertex_index = 0; vertex_index < input.num_vertices; ++vertex_index) {
+            const Vec4 current = input.vertices[vertex_index];
+            const f32 current_distance = plane_distance(plane, current, guard_band);
+
+            // Edge crosses the plane, add the intersection
+            if ((previous_distance >= 0.f) != (current_distance >= 0.f)) {
+                const f32 t = previous_distance / (previous_distance - current_distance);
+                polygon.vertices[polygon.num_vertices++] = previous + ((current - previous) * t);
+            }
+
+            if (current_distance >= 0.f) {
+                polygon.vertices[polygon.num_vertices++] = current;
+            }
+
+            previous = current;
+            previous_distance = current_distance;
+        }
+    }
+
+    if (polygon.num_vertices < 3) {
+        polygon.num_vertices = 0;
+    }
+}
+
+
+} // namespace clipping
@@ -1,4 +1,5 @@
 #include "_color.h"
+#include "_simd.h"
 
 
 // =====================================================================================================================
@@ -6,10 +7,52 @@
 // =====================================================================================================================
 
 Color Color::with_intensity(const float percentage) const {
+#if SIMD_AVX2 || SIMD_SSE2
+    // All four channels in one multiply, alpha is scaled by 1
+    const __m128i zero = _mm_setzero_si128();
+    __m128i channels = _mm_cvtsi32_si128(static_cast<i32>(hex));
+    channels = _mm_unpacklo_epi16(_mm_unpacklo_epi8(channels, zero), zero);
+
+    const __m128 scaled = _mm_mul_ps(_mm_cvtepi32_ps(channels), _mm_setr_ps(percentage, percentage, percentage, 1.f));
+
+    channels = _mm_cvttps_epi32(scaled);
+    channels = _mm_packus_epi16(_mm_packs_epi32(channels, channels), channels);
+    return Color{.hex = static_cast<u32>(_mm_cvtsi128_si32(channels))};
+#else
     return Color{
         .b = static_cast<u8>(static_cast<f32>(b) * percentage),
         .g = static_cast<u8>(static_cast<f32>(g) * percentage),
         .r = static_cast<u8>(static_cast<f32>(r) * percentage),
         .a = a,
     };
+#endif
+}
+
+
+void Color::apply_intensities(const std::span<Color> colors, const std::span<const f32> intensities) {
+    assert(colors.size() == intensities.size());
+
+    const simd::I32_Lanes channel_mask = simd::splat(0xFF);
+    const simd::I32_Lanes alpha_mask = simd::splat(static_cast<i32>(0xFF000000));
+
+    usize idx = 0;
+    for (; idx + simd::width <= colors.size(); idx += simd::width) {
+        u32* const dst = reinterpret_cast<u32*>(&colors[idx]);
+        const simd::I32_Lanes hex = simd::load(dst);
+        const simd::F32_Lanes percentage = simd::load(&intensities[idx]);
+
+        const simd::F32_Lanes b = simd::to_f32(hex & channel_mask);
+        const simd::F32_Lanes g = simd::to_f32(simd::shift_right(hex, 8) & channel_mask);
+        const simd::F32_Lanes r = simd::to_f32(simd::shift_right(hex, 16) & channel_mask);
+
+        const simd::I32_Lanes shaded = (hex & alpha_mask) |
+                                       simd::shift_left(simd::to_i32_truncated(r * percentage), 16) |
+                                       simd::shift_left(simd::to_i32_truncated(g * percentage), 8) |
+                                       simd::to_i32_truncated(b * percentage);
+        simd::store(dst, shaded);
+    }
+
+    for (; idx < colors.size(); ++idx) {
+        colors[idx] = colors[idx].with_intensity(intensities[idx]);
+    }
 }
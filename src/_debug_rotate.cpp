@@ -22,9 +22,6 @@ void Debug_Rotate_System::update(Registry& reg) {
     const f32 rot_angle = static_cast<f32>(math::tau) * t;
 
     for (const Entity entity: get_entities()) {
-        Transform& transform = reg.get<Transform>(entity);
-        transform.rotation.x = rot_angle;
-        transform.rotation.y = rot_angle;
-        transform.rotation.z = rot_angle;
+        reg.get<Transform>(entity).set_rotation(Vec3{rot_angle, rot_angle, rot_angle});
     }
 }
@@ -0,0 +1,36 @@
+#include "_frame_arena.h"
+
+
+// =====================================================================================================================
+// == Frame_Arena_System ===============================================================================================
+// =====================================================================================================================
+
+Frame_Arena_System::Frame_Arena_System() = default;
+
+
+void Frame_Arena_System::update() {
+    arena.reset();
+
+#if ENABLE_ALLOCATION_COUNTING
+    const u64 num_heap_allocations = memory::num_heap_allocations();
+    heap_allocations_last_frame = num_heap_allocations - num_heap_allocations_at_frame_start;
+    num_heap_allocations_at_frame_start = num_heap_allocations;
+
+    if (frame_index > num_warm_up_frames && heap_allocations_last_frame > 0) {
+        WARN("frame " << frame_index << " made " << heap_allocations_last_frame << " heap allocations");
+    }
+    ++frame_index;
+#endif
+}
+
+
+Frame_Arena& Frame_Arena_System::get_arena() {
+    return arena;
+}
+
+
+#if ENABLE_ALLOCATION_COUNTING
+u64 Frame_Arena_System::get_heap_allocations_last_frame() const {
+    return heap_allocations_last_frame;
+}
+#endif
@@ -1,4 +1,5 @@
 #include "_math.h"
+#include "_simd.h"
 
 #include <cassert>
 #include <cmath>
@@ -372,6 +373,69 @@ Mat4 Mat4::rot_z(const float angle) {
 }
 
 
+Mat4 Mat4::normal_matrix(const Mat4& m) {
+    // cofactor(M) * cross(a, b) == cross(M * a, M * b)
+    Mat4 mat;
+    mat.rows[0] = {m[1][1] * m[2][2] - m[1][2] * m[2][1],
+                   m[1][2] * m[2][0] - m[1][0] * m[2][2],
+                   m[1][0] * m[2][1] - m[1][1] * m[2][0],
+                   0};
+    mat.rows[1] = {m[0][2] * m[2][1] - m[0][1] * m[2][2],
+                   m[0][0] * m[2][2] - m[0][2] * m[2][0],
+                   m[0][1] * m[2][0] - m[0][0] * m[2][1],
+                   0};
+    mat.rows[2] = {m[0][1] * m[1][2] - m[0][2] * m[1][1],
+                   m[0][2] * m[1][0] - m[0][0] * m[1][2],
+                   m[0][0] * m[1][1] - m[0][1] * m[1][0],
+                   0};
+    mat.rows[3] = {0, 0, 0, 1};
+    return mat;
+}
+
+
+Mat4 Mat4::affine_inverse(const Mat4& m) {
+    // The inverse of the upper 3x3 is its transposed cofactor matrix divided by the determinant
+    const Mat4 cofactors = normal_matrix(m);
+    const f32 determinant = determinant_3x3(m);
+    assert(determinant != 0.f);
+
+    const f32 inverse_determinant = 1.f / determinant;
+
+    Mat4 mat;
+    for (usize row = 0; row < 3; ++row) {
+        for (usize col = 0; col < 3; ++col) {
+            mat.rows[row][col] = cofactors[col][row] * inverse_determinant;
+        }
+    }
+
+    // Undo the translation
+    for (usize row = 0; row < 3; ++row) {
+        mat.rows[row][3] = -(mat[row][0] * m[0][3] + mat[row][1] * m[1][3] + mat[row][2] * m[2][3]);
+    }
+
+    mat.rows[3] = {0, 0, 0, 1};
+    return mat;
+}
+
+
+f32 Mat4::determinant_3x3(const Mat4& m) {
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) +
+           m[0][1] * (m[1][2] * m[2][0] - m[1][0] * m[2][2]) +
+           m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+
+f32 Mat4::max_axis_scale(const Mat4& m) {
+    // Length of the transformed basis vectors (columns)
+    f32 max_sq_scale = 0.f;
+    for (usize column = 0; column < 3; ++column) {
+        const Vec3 basis{m[0][column], m[1][column], m[2][column]};
+        max_sq_scale = std::max(max_sq_scale, math::sq_magnitude(basis));
+    }
+    return std::sqrt(max_sq_scale);
+}
+
+
 const Vec4& Mat4::operator[](const usize row_index) const {
     return rows[row_index];
 }
@@ -518,3 +582,164 @@ Vec4 math::perspective_divide(Vec4 vec) {
     vec.z /= vec.w;
     return vec;
 }
+
+
+// =====================================================================================================================
+// == namespace math, batch kernels ====================================================================================
+// =====================================================================================================================
+
+void math::transform_points(const Mat4& mat, const std::span<const Vec3> points,
+                            const std::span<Vec4> transformed_points) {
+    assert(points.size() == transformed_points.size());
+
+#if SIMD_AVX2 || SIMD_SSE2
+    // One point per register, as a sum of the matrix columns scaled by the point's components. The additions happen
+    // in the same order as in the row dot products of operator*, so results are identical.
+    const __m128 column_0 = _mm_setr_ps(mat[0][0], mat[1][0], mat[2][0], mat[3][0]);
+    const __m128 column_1 = _mm_setr_ps(mat[0][1], mat[1][1], mat[2][1], mat[3][1]);
+    const __m128 column_2 = _mm_setr_ps(mat[0][2], mat[1][2], mat[2][2], mat[3][2]);
+    const __m128 column_3 = _mm_setr_ps(mat[0][3], mat[1][3], mat[2][3], mat[3][3]);
+
+    for (usize point_index = 0; point_index < points.size(); ++point_index) {
+        const Vec3& point = points[point_index];
+
+        __m128 result = _mm_add_ps(_mm_mul_ps(column_0, _mm_set1_ps(point.x)),
+                                   _mm_mul_ps(column_1, _mm_set1_ps(point.y)));
+        result = _mm_add_ps(result, _mm_mul_ps(column_2, _mm_set1_ps(point.z)));
+        result = _mm_add_ps(result, column_3);
+
+        _mm_storeu_ps(transformed_points[point_index].elements, result);
+    }
+#else
+    for (usize point_index = 0; point_index < points.size(); ++point_index) {
+        transformed_points[point_index] = mat * Vec4::from_vec3(points[point_index], 1.f);
+    }
+#endif
+}
+
+
+void math::transform_points(const Mat4& mat, const Vec3_Streams points, const Vec4_Streams transformed_points) {
+    const usize num_points = points.x.size();
+    assert(points.y.size() == num_points && points.z.size() == num_points);
+    assert(transformed_points.x.size() == num_points && transformed_points.y.size() == num_points &&
+           transformed_points.z.size() == num_points && transformed_points.w.size() == num_points);
+
+    const std::span<f32> output_streams[4]{
+        transformed_points.x, transformed_points.y, transformed_points.z, transformed_points.w,
+    };
+
+    usize point_index = 0;
+
+    for (; point_index + simd::width <= num_points; point_index += simd::width) {
+        const simd::F32_Lanes x = simd::load(&points.x[point_index]);
+        const simd::F32_Lanes y = simd::load(&points.y[point_index]);
+        const simd::F32_Lanes z = simd::load(&points.z[point_index]);
+
+        for (usize row = 0; row < 4; ++row) {
+            const simd::F32_Lanes result = simd::splat(mat[row][0]) * x +
+                                           simd::splat(mat[row][1]) * y +
+                                           simd::splat(mat[row][2]) * z +
+                                           simd::splat(mat[row][3]);
+
+            simd::store(&output_streams[row][point_index], result);
+        }
+    }
+
+    // Remainder
+    for (; point_index < num_points; ++point_index) {
+        const Vec4 point{points.x[point_index], points.y[point_index], points.z[point_index], 1.f};
+
+        for (usize row = 0; row < 4; ++row) {
+            output_streams[row][point_index] = dot(mat[row], point);
+        }
+    }
+}
+
+
+void math::project_to_viewport(const std::span<const Vec4> clip_points, const Vec2 viewport_size,
+                               const std::span<Vec4> screen_points) {
+    assert(clip_points.size() == screen_points.size());
+
+    const f32 half_width = viewport_size.width / 2.f;
+    const f32 half_height = viewport_size.height / 2.f;
+
+#if SIMD_AVX2 || SIMD_SSE2
+    const __m128 scale = _mm_setr_ps(half_width, -half_height, 1.f, 1.f);
+    const __m128 offset = _mm_setr_ps(half_width, half_height, 0.f, 0.f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 w_lane_mask = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+
+    for (usize point_index = 0; point_index < clip_points.size(); ++point_index) {
+        const __m128 point = _mm_loadu_ps(clip_points[point_index].elements);
+
+        // Divide by w, or by 1 where w is zero and the point is left as is (see perspective_divide)
+        __m128 w = _mm_shuffle_ps(point, point, _MM_SHUFFLE(3, 3, 3, 3));
+        const __m128 is_w_zero = _mm_cmpeq_ps(w, _mm_setzero_ps());
+        w = _mm_or_ps(_mm_and_ps(is_w_zero, one), _mm_andnot_ps(is_w_zero, w));
+
+        __m128 result = _mm_add_ps(_mm_mul_ps(_mm_div_ps(point, w), scale), offset);
+
+        // Keep w
+        result = _mm_or_ps(_mm_and_ps(w_lane_mask, point), _mm_andnot_ps(w_lane_mask, result));
+
+        _mm_storeu_ps(screen_points[point_index].elements, result);
+    }
+#else
+    for (usize point_index = 0; point_index < clip_points.size(); ++point_index) {
+        const Vec4 projected_point = perspective_divide(clip_points[point_index]);
+
+        screen_points[point_index] = Vec4{
+            (projected_point.x * half_width) + half_width,
+            (projected_point.y * -half_height) + half_height,
+            projected_point.z,
+            clip_points[point_index].w,
+        };
+    }
+#endif
+}
+
+
+void math::project_to_viewport(const Vec4_Streams clip_points, const Vec2 viewport_size,
+                               const Vec4_Streams screen_points) {
+    const usize num_points = clip_points.x.size();
+    assert(clip_points.y.size() == num_points && clip_points.z.size() == num_points &&
+           clip_points.w.size() == num_points);
+    assert(screen_points.x.size() == num_points && screen_points.y.size() == num_points &&
+           screen_points.z.size() == num_points && screen_points.w.size() == num_points);
+
+    const f32 half_width = viewport_size.width / 2.f;
+    const f32 half_height = viewport_size.height / 2.f;
+
+    usize point_index = 0;
+
+    const simd::F32_Lanes half_width_lanes = simd::splat(half_width);
+    const simd::F32_Lanes half_height_lanes = simd::splat(half_height);
+    const simd::F32_Lanes negative_half_height_lanes = simd::splat(-half_height);
+    const simd::F32_Lanes zero = simd::splat(0.f);
+    const simd::F32_Lanes one = simd::splat(1.f);
+
+    for (; point_index + simd::width <= num_points; point_index += simd::width) {
+        const simd::F32_Lanes w = simd::load(&clip_points.w[point_index]);
+        const simd::F32_Lanes divisor = simd::select(simd::equal(w, zero), one, w);
+
+        const simd::F32_Lanes x = simd::load(&clip_points.x[point_index]) / divisor;
+        const simd::F32_Lanes y = simd::load(&clip_points.y[point_index]) / divisor;
+        const simd::F32_Lanes z = simd::load(&clip_points.z[point_index]) / divisor;
+
+        simd::store(&screen_points.x[point_index], x * half_width_lanes + half_width_lanes);
+        simd::store(&screen_points.y[point_index], y * negative_half_height_lanes + half_height_lanes);
+        simd::store(&screen_points.z[point_index], z);
+        simd::store(&screen_points.w[point_index], w);
+    }
+
+    // Remainder
+    for (; point_index < num_points; ++point_index) {
+        const f32 w = clip_points.w[point_index];
+        const f32 divisor = w == 0.f ? 1.f : w;
+
+        screen_points.x[point_index] = (clip_points.x[point_index] / divisor) * half_width + half_width;
+        screen_points.y[point_index] = (clip_points.y[point_index] / divisor) * -half_height + half_height;
+        screen_points.z[point_index] = clip_points.z[point_index] / divisor;
+        screen_points.w[point_index] = w;
+    }
+}
@@ -0,0 +1,153 @@
+#include "_memory.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+
+
+// =====================================================================================================================
+// == Frame_Arena ======================================================================================================
+// =====================================================================================================================
+
+static u8* allocate_block(const usize capacity, const usize alignment) {
+    return static_cast<u8*>(::operator new(capacity, std::align_val_t{alignment}));
+}
+
+
+static void free_block(u8* data, const usize alignment) {
+    ::operator delete(data, std::align_val_t{alignment});
+}
+
+
+Frame_Arena::Frame_Arena(const usize capacity) {
+    blocks.emplace_back() = Block{
+        .data = allocate_block(capacity, block_alignment),
+        .capacity = capacity,
+    };
+}
+
+
+Frame_Arena::~Frame_Arena() {
+    for (const Block& block : blocks) {
+        free_block(block.data, block_alignment);
+    }
+}
+
+
+void* Frame_Arena::allocate(const usize size, const usize alignment) {
+    assert(alignment <= block_alignment && (alignment & (alignment - 1)) == 0);
+
+    usize start = (offset + alignment - 1) & ~(alignment - 1);
+
+    if (start + size > blocks.back().capacity) {
+        // Spill into a new block, at least as large as all of the others together so that spilling stays rare
+        const usize capacity = std::max(size, get_capacity());
+        blocks.emplace_back() = Block{
+            .data = allocate_block(capacity, block_alignment),
+            .capacity = capacity,
+        };
+        start = 0;
+    }
+
+    offset = start + size;
+    return blocks.back().data + start;
+}
+
+
+void Frame_Arena::reset() {
+    // Replace the blocks of a frame that spilled with a single one that fits all of them
+    if (blocks.size() > 1) {
+        const usize capacity = get_capacity();
+
+        for (const Block& block : blocks) {
+            free_block(block.data, block_alignment);
+        }
+        blocks.resize(1);
+        blocks[0] = Block{
+            .data = allocate_block(capacity, block_alignment),
+            .capacity = capacity,
+        };
+    }
+
+    offset = 0;
+}
+
+
+usize Frame_Arena::get_capacity() const {
+    usize capacity = 0;
+    for (const Block& block : blocks) {
+        capacity += block.capacity;
+    }
+    return capacity;
+}
+
+
+// =====================================================================================================================
+// == Allocation counting ==============================================================================================
+// =====================================================================================================================
+
+// Replaces the global operator new and delete with versions that count allocations, to check that steady state frames
+// don't allocate. The array and nothrow versions of the standard library forward to these.
+#if ENABLE_ALLOCATION_COUNTING
+
+static std::atomic<u64> heap_allocation_count{0};
+
+
+u64 memory::num_heap_allocations() {
+    return heap_allocation_count.load(std::memory_order_relaxed);
+}
+
+
+void* operator new(const usize size) {
+    heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    if (void* ptr = std::malloc(size == 0 ? 1 : size)) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+
+void* operator new(const usize size, const std::align_val_t alignment) {
+    heap_allocation_count.fetch_add(1, std::memory_order_relaxed);
+
+    const usize alignment_bytes = static_cast<usize>(alignment);
+#if defined(_MSC_VER)
+    void* ptr = _aligned_malloc(size == 0 ? 1 : size, alignment_bytes);
+#else
+    // aligned_alloc wants a multiple of the alignment
+    const usize rounded_size = std::max((size + alignment_bytes - 1) & ~(alignment_bytes - 1), alignment_bytes);
+    void* ptr = std::aligned_alloc(alignment_bytes, rounded_size);
+#endif
+    if (ptr) {
+        return ptr;
+    }
+    throw std::bad_alloc{};
+}
+
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+
+void operator delete(void* ptr, usize) noexcept {
+    std::free(ptr);
+}
+
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+#if defined(_MSC_VER)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+
+void operator delete(void* ptr, usize, const std::align_val_t alignment) noexcept {
+    operator delete(ptr, alignment);
+}
+
+#endif
@@ -1,19 +1,67 @@
 #include "_mesh_render.h"
 
 #include "_asset_store.h"
+#include "_bvh.h"
 #include "_camera.h"
+#include "_clipping.h"
+#include "_frame_arena.h"
+#include "_meshlet.h"
+#include "_radix_sort.h"
 #include "_renderer.h"
+#include "_tile_raster.h"
 #include "_window.h"
 
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
 
 constexpr bool enable_culling = true;
 
+// Draw opaque triangles front to back, so that the depth buffer rejects as much of what's behind them as possible. Off,
+// the coarse depth blocks already reject most hidden triangles and the sort costs more than it saves in our scenes.
+constexpr bool enable_front_to_back = false;
+
+// How far outside of the viewport (in pixels) triangles may reach before they get clipped against the sides of the
+// view volume. Shrinks for viewports so large that it would reach past Render_System::max_raster_coordinate.
+constexpr f32 guard_band_margin = 2048.f;
+
+// Coarsest level of detail whose simplification error stays below this many pixels on screen is drawn
+constexpr f32 lod_error_threshold_pixels = 1.f;
+
+
+// Sort key of a triangle, ordered by depth first. Meshes don't have materials yet, that field is reserved.
+//   63..32 nearest depth    31..16 material    15..0 mesh
+static u64 pack_draw_key(const f32 depth, const u16 material, const Mesh_Id mesh_id) {
+    assert(mesh_id.id <= std::numeric_limits<u16>::max());
+    return (static_cast<u64>(radix_sort::ordered_bits(depth)) << 32) |
+           (static_cast<u64>(material) << 16) |
+           static_cast<u64>(static_cast<u16>(mesh_id.id));
+}
+
 
-Mesh_Render_System::Mesh_Render_System(const Registry& reg)
+// Signed volume spanned by the clip space corners in homogeneous 2D (x, y, w). Equals the view space triple product
+// p0 . (p1 x p2) up to a positive scale, so its sign tells the winding as seen from the camera without a perspective
+// divide, and stays valid for corners behind the camera.
+static f32 clip_space_determinant(const std::array<Vec4, 3>& corners) {
+    const Vec4& a = corners[0];
+    const Vec4& b = corners[1];
+    const Vec4& c = corners[2];
+
+    return a.x * (b.y * c.w - b.w * c.y) +
+           a.y * (b.w * c.x - b.x * c.w) +
+           a.w * (b.x * c.y - b.y * c.x);
+}
+
+
+Mesh_Render_System::Mesh_Render_System(Registry& reg)
     : window(reg.get<Window_System>()),
       renderer(reg.get<Render_System>()),
+      tile_raster(reg.get<Tile_Raster_System>()),
       camera(reg.get<Camera_System>()),
-      asset_store(reg.get<Asset_Store_System>()) {
+      asset_store(reg.get<Asset_Store_System>()),
+      bvh(reg.has<Bvh_System>() ? &reg.get<Bvh_System>() : nullptr),
+      frame_arena(reg.get<Frame_Arena_System>().get_arena()) {
 
     require_component<Transform>();
     require_component<Mesh_Id>();
@@ -21,116 +69,288 @@ Mesh_Render_System::Mesh_Render_System(const Registry& reg)
 
 
 void Mesh_Render_System::update(Registry& reg) {
-    triangles_to_draw.clear();
-    triangle_depth_values.clear();
-    triangle_draw_colors.clear();
+    // Scratch for this frame only. Sized after the last frame, triangle counts barely change from one frame to the
+    // next, so the vectors rarely have to grow and leave their old storage behind in the arena.
+    Arena_Vector<Raster_Triangle> triangles_to_draw{Arena_Allocator<Raster_Triangle>{frame_arena}};
+    Arena_Vector<f32> triangle_light_intensities{Arena_Allocator<f32>{frame_arena}};
+    Arena_Vector<u64> draw_keys{Arena_Allocator<u64>{frame_arena}};
+
+    triangles_to_draw.reserve(num_triangles_last_frame);
+    triangle_light_intensities.reserve(num_triangles_last_frame);
+    if constexpr (enable_front_to_back) {
+        draw_keys.reserve(num_triangles_last_frame);
+    }
 
     const f32 half_window_width = static_cast<f32>(window.width) / 2.f;
     const f32 half_window_height = static_cast<f32>(window.height) / 2.f;
 
-    const Mat4 projection_matrix = camera.get_projection_matrix();
+    // Extent of the guard band in normalized device coordinates. Triangles only get clipped against the sides of the
+    // view volume once they reach outside of it, the rasterizer discards everything off screen. Screen coordinates
+    // inside of it span -margin to size + margin, and the rasterizer drops triangles past max_raster_coordinate, with
+    // a pixel to spare for rounding in the clipper.
+    assert(window.width < Render_System::max_raster_coordinate && window.height < Render_System::max_raster_coordinate);
+    auto guard_band_extent = [](const f32 half_size) -> f32 {
+        const f32 max_margin = Render_System::max_raster_coordinate - (2.f * half_size) - 1.f;
+        return (half_size + std::clamp(max_margin, 0.f, guard_band_margin)) / half_size;
+    };
+    const Vec2 guard_band{guard_band_extent(half_window_width), guard_band_extent(half_window_height)};
+
+    const Mat4 view_matrix = camera.get_view_matrix();
+    const Mat4 view_projection_matrix = camera.get_view_projection_matrix();
+
+    // Pixels covered by one world space unit at a view space depth of 1
+    const f32 pixels_per_unit_at_unit_depth = camera.get_projection_matrix()[1][1] * half_window_height;
+    const Frustum frustum = camera.get_frustum();
+
+    const Vec2 viewport_size{static_cast<f32>(window.width), static_cast<f32>(window.height)};
+
+    // Screen space corners from math::project_to_viewport
+    auto add_triangle_to_draw = [&](const std::array<Vec4, 3>& screen_corners,
+                                    const f32 light_intensity,
+                                    const Mesh_Id mesh_id) -> void {
+        Raster_Triangle& triangle = triangles_to_draw.emplace_back();
+
+        for (usize corner_index = 0; corner_index < 3; ++corner_index) {
+            // Kept at subpixel precision for the rasterizer
+            triangle.corners[corner_index] = Vec2{screen_corners[corner_index].x, screen_corners[corner_index].y};
+            triangle.depths[corner_index] = screen_corners[corner_index].z;
+        }
+
+        triangle_light_intensities.emplace_back() = light_intensity;
 
+        if constexpr (enable_front_to_back) {
+            const f32 nearest_depth = std::min({triangle.depths[0], triangle.depths[1], triangle.depths[2]});
+            draw_keys.emplace_back() = pack_draw_key(nearest_depth, 0, mesh_id);
+        }
+    };
 
-    for (const Entity entity : get_entities()) {
-        const Mesh_Id mesh_id = reg.get<Mesh_Id>(entity);
-        const Mesh_View mesh = asset_store.access_mesh_data(mesh_id);
 
-        Transform& transform = reg.get<Transform>(entity);
-        transform.update_world_matrix();
+    // Candidates that may be visible. Sorted so that submission order doesn't depend on the tree layout.
+    std::span<const Entity> entities = get_entities();
+    if (bvh) {
+        visible_entities.clear();
+        bvh->query_visible(frustum, visible_entities);
+        std::sort(visible_entities.begin(), visible_entities.end());
 
-        const Mat4 world_matrix = transform.world_matrix;
+        entities = visible_entities;
+    }
 
 
-        for (usize face_index = 0; face_index < mesh.faces.size(); ++face_index) {
-            Vec3 face_corners[3]{
-                mesh.vertices[mesh.faces[face_index][0]],
-                mesh.vertices[mesh.faces[face_index][1]],
-                mesh.vertices[mesh.faces[face_index][2]],
-            };
+    // Instances grouped by mesh, every mesh is fetched once and its faces and vertices stay in cache while all of its
+    // instances are drawn. Sorted by entity within a mesh so that submission order doesn't depend on the tree layout.
+    instances.clear();
+    for (const Entity entity : entities) {
+        instances.emplace_back() = Instance{
+            .mesh_id = reg.get<Mesh_Id>(entity),
+            .entity = entity,
+        };
+    }
+    std::sort(instances.begin(), instances.end(), [](const Instance& a, const Instance& b) -> bool {
+        return a.mesh_id.id != b.mesh_id.id ? a.mesh_id.id < b.mesh_id.id : a.entity < b.entity;
+    });
 
-            // Transformation
-            for (Vec3& corner : face_corners) {
-                corner = Vec3::from_vec4(world_matrix *
-                                         Vec4::from_vec3(corner, 1.f)
-                                         );
-            }
 
+    for (usize group_start = 0; group_start < instances.size(); ) {
+        const Mesh_Id mesh_id = instances[group_start].mesh_id;
 
-            const Vec3 face_normal_not_normalized = math::cross(face_corners[1] - face_corners[0],
-                                                                face_corners[2] - face_corners[0]
-                                                                );
+        usize group_end = group_start + 1;
+        while (group_end < instances.size() && instances[group_end].mesh_id.id == mesh_id.id) {
+            ++group_end;
+        }
+        const usize num_instances = group_end - group_start;
 
-            // Temporary culling solution
-            if constexpr (enable_culling) {
-                const Vec3 ray_to_face_corner = face_corners[0] - camera.get_position();
+        const Mesh_View mesh = asset_store.access_mesh_data(mesh_id);
 
-                if (const bool should_cull_face = math::dot(face_normal_not_normalized, ray_to_face_corner) >= 0;
-                    should_cull_face) {
-                    continue;
-                }
-            }
+        instance_world_matrices.clear();
+        for (usize instance_index = group_start; instance_index < group_end; ++instance_index) {
+            const Transform& transform = reg.get<Transform>(instances[instance_index].entity);
+            instance_world_matrices.emplace_back() = transform.get_world_matrix();
+        }
 
+        group_start = group_end;
 
-            // Flat shading
-            f32 light_intensity = -math::dot(light.direction, math::normalized(face_normal_not_normalized));
-            if (light_intensity < 0.f)  {
-                light_intensity = 0.0f;
+
+        // Frustum culling, whole instances are skipped before any of their vertices get transformed. The bounding
+        // spheres of all instances are transformed and tested at once, vectorized across instances. The box test
+        // after that is tighter for elongated meshes. Still needed with the BVH, its leaves are fat boxes.
+        instance_spheres.resize(num_instances);
+        is_instance_outside.resize(num_instances);
+
+        mesh.bounds.sphere.transformed(instance_world_matrices, instance_spheres.view());
+        frustum.are_outside(instance_spheres.view(), is_instance_outside);
+
+        for (usize instance_index = 0; instance_index < num_instances; ++instance_index) {
+            const Mat4& world_matrix = instance_world_matrices[instance_index];
+
+            if (is_instance_outside[instance_index] || frustum.is_outside(mesh.bounds.box.transformed(world_matrix))) {
+                continue;
             }
-            triangle_draw_colors.emplace_back() = Color::white().with_intensity(light_intensity);
 
+            const Bounding_Sphere world_sphere = instance_spheres[instance_index];
 
-            // Temporary depth buffer
-            triangle_depth_values.emplace_back() = face_corners[0].z + face_corners[1].z + face_corners[2].z; // / 3.f;
 
+            // Level of detail, from the error projected at the nearest depth of the bounding sphere. Instances
+            // reaching up to the camera always get the full mesh.
+            usize lod_index = 0;
+            {
+                const f32 center_depth = (view_matrix * Vec4::from_vec3(world_sphere.center, 1.f)).z;
+                const f32 nearest_depth = center_depth - world_sphere.radius;
 
-            // Projection
-            //
-            Triangle& triangle = triangles_to_draw.emplace_back();
+                if (nearest_depth > 0.f) {
+                    const f32 pixels_per_object_unit = pixels_per_unit_at_unit_depth *
+                                                       Mat4::max_axis_scale(world_matrix) / nearest_depth;
 
-            for (usize corner_index = 0; corner_index < 3; ++corner_index) {
+                    while (lod_index + 1 < mesh.num_lods &&
+                           mesh.lods[lod_index + 1].error * pixels_per_object_unit <= lod_error_threshold_pixels) {
+                        ++lod_index;
+                    }
+                }
+            }
+            const Mesh_Lod& lod = mesh.lods[lod_index];
 
-                // Convert coordinates to image space / normalized device coordinates
-                Vec4 projected_corner = projection_matrix * Vec4::from_vec3(face_corners[corner_index], 1.f);
-                projected_corner = math::perspective_divide(projected_corner);
 
+            // Object space straight to clip space with a single multiply per vertex. World space is only needed for
+            // the face normals used in lighting, which go through the normal matrix instead of transformed corners.
+            const Mat4 model_view_projection_matrix = view_projection_matrix * world_matrix;
+            const Mat4 normal_matrix = Mat4::normal_matrix(world_matrix);
 
-                // Flip y (positive y up)
-                projected_corner.y = -projected_corner.y;
+            // The meshlet normal cones are tested in object space, the camera is moved there instead. Mirroring
+            // world matrices flip the winding that the cones were built for, and ones that scale an axis to zero
+            // have no inverse.
+            const bool is_meshlet_culling_valid = Mat4::determinant_3x3(world_matrix) > 0.f;
+            const Vec3 camera_position_object_space = is_meshlet_culling_valid
+                ? Vec3::from_vec4(Mat4::affine_inverse(world_matrix) * Vec4::from_vec3(camera.get_position(), 1.f))
+                : Vec3::zeroed();
 
-                // Translate origin to the middle of the viewport, then scale
 
-                // scale
-                projected_corner.x *= half_window_width;
-                projected_corner.y *= half_window_height;
+            // Post-transform vertex cache. Every vertex is shared by several faces, so transform and project each
+            // one once up front and assemble faces by index afterwards. Positions come as padded structure of arrays
+            // streams, so the kernels only ever run on full SIMD registers.
+            //
+            clip_vertices.resize(lod.positions.x.size());
+            screen_vertices.resize(lod.positions.x.size());
 
-                // translate
-                projected_corner.x += half_window_width;
-                projected_corner.y += half_window_height;
+            math::transform_points(model_view_projection_matrix, lod.positions, clip_vertices.view());
+            math::project_to_viewport(clip_vertices.view(), viewport_size, screen_vertices.view());
 
 
-                // Cast to screen coordinates
+            // Meshlet culling, whole clusters facing away or outside of the frustum are rejected with a single test
+            for (const Meshlet& meshlet : lod.meshlets) {
+                if constexpr (enable_culling) {
+                    if (is_meshlet_culling_valid && meshlet::is_backfacing(meshlet, camera_position_object_space)) {
+                        continue;
+                    }
+                }
+                if (lod.meshlets.size() > 1 && frustum.is_outside(meshlet.sphere.transformed(world_matrix))) {
+                    continue;
+                }
 
-                triangle[corner_index] = Vec2i{
-                    static_cast<i32>(projected_corner.x),
-                    static_cast<i32>(projected_corner.y),
-                };
+                const usize faces_end = meshlet.faces_start + meshlet.num_faces;
+
+                for (usize face_index = meshlet.faces_start; face_index < faces_end; ++face_index) {
+                    const Face_Vertex_Indices& face = lod.faces[face_index];
+
+                    const std::array<Vec4, 3> clip_corners{
+                        clip_vertices[face[0]],
+                        clip_vertices[face[1]],
+                        clip_vertices[face[2]],
+                    };
+
+
+                    // Backface culling
+                    if constexpr (enable_culling) {
+                        if (const bool should_cull_face = clip_space_determinant(clip_corners) >= 0.f;
+                            should_cull_face) {
+                            continue;
+                        }
+                    }
+
+
+                    // Flat shading
+                    const Vec4 object_face_normal = Vec4::from_vec3(lod.face_normals[face_index], 0.f);
+                    const Vec3 face_normal_not_normalized = Vec3::from_vec4(normal_matrix * object_face_normal);
+
+                    f32 light_intensity = -math::dot(light.direction, math::normalized(face_normal_not_normalized));
+                    if (light_intensity < 0.f)  {
+                        light_intensity = 0.0f;
+                    }
+                    light_intensity = std::min(light_intensity, 1.f);
+
+
+                    // Clipping
+                    //
+                    switch (clipping::classify_triangle(clip_corners, guard_band)) {
+                        case clipping::Triangle_Clip_Result::Outside: {
+                            continue;
+                        }
+                        case clipping::Triangle_Clip_Result::Inside: {
+                            add_triangle_to_draw({screen_vertices[face[0]],
+                                                  screen_vertices[face[1]],
+                                                  screen_vertices[face[2]]},
+                                                 light_intensity,
+                                                 mesh_id
+                                                 );
+                            continue;
+                        }
+                        case clipping::Triangle_Clip_Result::Needs_Clipping: {
+                            clipping::Polygon polygon = clipping::Polygon::from_triangle(clip_corners);
+                            clipping::clip_polygon(polygon, guard_band);
+
+                            const std::span<Vec4> polygon_vertices{polygon.vertices.data(), polygon.num_vertices};
+                            math::project_to_viewport(polygon_vertices, viewport_size, polygon_vertices);
+
+                            // The clipped polygon is convex, draw it as a triangle fan
+                            for (usize vertex_index = 1; vertex_index + 1 < polygon.num_vertices; ++vertex_index) {
+                                add_triangle_to_draw({polygon.vertices[0],
+                                                      polygon.vertices[vertex_index],
+                                                      polygon.vertices[vertex_index + 1]},
+                                                     light_intensity,
+                                                     mesh_id
+                                                     );
+                            }
+                            continue;
+                        }
+                    }
+                }
             }
         }
     }
 
-    // Calculate draw order based on depth values
-    triangle_draw_order.resize(triangles_to_draw.size());
-    std::iota(triangle_draw_order.begin(), triangle_draw_order.end(), 0);
-    std::sort(triangle_draw_order.begin(), triangle_draw_order.end(), [&](const usize a, const usize b) -> bool {
-        return triangle_depth_values[a] > triangle_depth_values[b]; // larger z == draw first
-    });
+    const usize num_triangles = triangles_to_draw.size();
+    num_triangles_last_frame = num_triangles;
 
+    const std::span<Color> triangle_draw_colors = frame_arena.allocate_array<Color>(num_triangles);
+    std::fill(triangle_draw_colors.begin(), triangle_draw_colors.end(), Color::white());
+    Color::apply_intensities(triangle_draw_colors, triangle_light_intensities);
 
-    renderer.draw_grid(10, 10, Color::grey());
 
-    for (const usize draw_index : triangle_draw_order) {
-        const Triangle& triangle = triangles_to_draw[draw_index];
-        const Color draw_color = triangle_draw_colors[draw_index];
-        renderer.draw_triangle_filled(triangle, draw_color);
+    // Draw order, by radix sorting the draw keys along with the triangle indices
+    //
+    std::span<const u32> triangle_draw_order;
+
+    if constexpr (enable_front_to_back) {
+        const std::span<u32> draw_order = frame_arena.allocate_array<u32>(num_triangles);
+        for (usize triangle_index = 0; triangle_index < num_triangles; ++triangle_index) {
+            draw_order[triangle_index] = static_cast<u32>(triangle_index);
+        }
+
+        radix_sort::sort(draw_keys,
+                         draw_order,
+                         frame_arena.allocate_array<u64>(num_triangles),
+                         frame_arena.allocate_array<u32>(num_triangles)
+                         );
+
+        triangle_draw_order = draw_order;
     }
+
+
+    renderer.draw_grid(10, 10, Color::grey());
+
+    // Depth tested, so the draw order only affects how much gets rejected early
+    tile_raster.draw_triangles_filled(triangles_to_draw, triangle_draw_colors, triangle_draw_order);
+}
+
+
+usize Mesh_Render_System::get_num_triangles_drawn() const {
+    return num_triangles_last_frame;
 }
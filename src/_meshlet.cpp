@@ -0,0 +1,182 @@
+#include "_meshlet.h"
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+
+void meshlet::build(const std::span<const Vec3> vertices,
+                    const std::span<const Face_Vertex_Indices> faces,
+                    const std::span<const Vec3> face_normals,
+                    std::vector<Meshlet>& meshlets,
+                    std::vector<u32>& face_order) {
+    assert(faces.size() == face_normals.size());
+
+    meshlets.clear();
+    face_order.clear();
+    face_order.reserve(faces.size());
+
+
+    // Faces around every vertex, packed per vertex
+    //
+    std::vector<u32> vertex_faces_start(vertices.size() + 1, 0);
+    for (const Face_Vertex_Indices& face : faces) {
+        for (const u16 vertex_index : face) {
+            ++vertex_faces_start[vertex_index + 1];
+        }
+    }
+    for (usize vertex_index = 0; vertex_index < vertices.size(); ++vertex_index) {
+        vertex_faces_start[vertex_index + 1] += vertex_faces_start[vertex_index];
+    }
+
+    std::vector<u32> vertex_faces(vertex_faces_start.back());
+    {
+        std::vector<u32> vertex_faces_end(vertex_faces_start.begin(), vertex_faces_start.end() - 1);
+        for (usize face_index = 0; face_index < faces.size(); ++face_index) {
+            for (const u16 vertex_index : faces[face_index]) {
+                vertex_faces[vertex_faces_end[vertex_index]++] = static_cast<u32>(face_index);
+            }
+        }
+    }
+
+
+    std::vector<Vec3> unit_face_normals(faces.size());
+    for (usize face_index = 0; face_index < faces.size(); ++face_index) {
+        unit_face_normals[face_index] = math::normalized(face_normals[face_index]);
+    }
+
+    constexpr u32 no_meshlet = std::numeric_limits<u32>::max();
+
+    std::vector<bool> is_face_assigned(faces.size(), false);
+    std::vector<u32> vertex_meshlet(vertices.size(), no_meshlet);   // last meshlet that used the vertex
+
+    std::vector<u32> candidate_faces;
+    std::vector<Vec3> meshlet_vertices;
+    meshlet_vertices.reserve(max_vertices);
+
+    usize seed_face_index = 0;
+
+    while (true) {
+        while (seed_face_index < faces.size() && is_face_assigned[seed_face_index]) {
+            ++seed_face_index;
+        }
+        if (seed_face_index == faces.size()) {
+            break;
+        }
+
+        const u32 meshlet_index = static_cast<u32>(meshlets.size());
+
+        Meshlet meshlet{};
+        meshlet.faces_start = static_cast<u32>(face_order.size());
+
+        Vec3 normal_sum = Vec3::zeroed();
+        candidate_faces.clear();
+        meshlet_vertices.clear();
+
+        auto count_new_vertices = [&](const u32 face_index) -> usize {
+            usize num_new_vertices = 0;
+            for (const u16 vertex_index : faces[face_index]) {
+                num_new_vertices += vertex_meshlet[vertex_index] != meshlet_index;
+            }
+            return num_new_vertices;
+        };
+
+        auto add_face = [&](const u32 face_index) -> void {
+            is_face_assigned[face_index] = true;
+            face_order.push_back(face_index);
+            ++meshlet.num_faces;
+            normal_sum += unit_face_normals[face_index];
+
+            for (const u16 vertex_index : faces[face_index]) {
+                if (vertex_meshlet[vertex_index] != meshlet_index) {
+                    vertex_meshlet[vertex_index] = meshlet_index;
+                    meshlet_vertices.push_back(vertices[vertex_index]);
+                }
+
+                const u32 vertex_faces_end = vertex_faces_start[vertex_index + 1];
+                for (u32 index = vertex_faces_start[vertex_index]; index < vertex_faces_end; ++index) {
+                    if (!is_face_assigned[vertex_faces[index]]) {
+                        candidate_faces.push_back(vertex_faces[index]);
+                    }
+                }
+            }
+        };
+
+        add_face(static_cast<u32>(seed_face_index));
+
+
+        // Grow
+        //
+        while (meshlet.num_faces < max_faces) {
+            const Vec3 axis = math::normalized(normal_sum);
+
+            i64 best_candidate = -1;
+            usize best_num_new_vertices = 4;
+            f32 best_alignment = -std::numeric_limits<f32>::max();
+
+            for (usize candidate = 0; candidate < candidate_faces.size(); ++candidate) {
+                const u32 face_index = candidate_faces[candidate];
+
+                if (is_face_assigned[face_index]) {
+                    candidate_faces[candidate--] = candidate_faces.back();
+                    candidate_faces.pop_back();
+                    continue;
+                }
+
+                const usize num_new_vertices = count_new_vertices(face_index);
+                if (meshlet_vertices.size() + num_new_vertices > max_vertices) {
+                    continue;
+                }
+
+                const f32 alignment = math::dot(unit_face_normals[face_index], axis);
+
+                if (num_new_vertices < best_num_new_vertices ||
+                    (num_new_vertices == best_num_new_vertices && alignment > best_alignment)) {
+                    best_candidate = static_cast<i64>(face_index);
+                    best_num_new_vertices = num_new_vertices;
+                    best_alignment = alignment;
+                }
+            }
+
+            if (best_candidate < 0) {
+                break;
+            }
+
+            add_face(static_cast<u32>(best_candidate));
+        }
+
+
+        // Bounds and normal cone
+        //
+        meshlet.sphere = Bounding_Sphere::from_points(meshlet_vertices);
+        meshlet.cone_axis = math::normalized(normal_sum);
+
+        f32 min_alignment = 1.f;
+        for (u32 face = meshlet.faces_start; face < meshlet.faces_start + meshlet.num_faces; ++face) {
+            const Vec3& normal = unit_face_normals[face_order[face]];
+
+            // Degenerate faces are never drawn
+            if (math::sq_magnitude(normal) == 0.f) {
+                continue;
+            }
+            min_alignment = std::min(min_alignment, math::dot(normal, meshlet.cone_axis));
+        }
+
+        meshlet.cone_cutoff = min_alignment > 0.f
+                            ? std::sqrt(1.f - (min_alignment * min_alignment))
+                            : 2.f;
+
+        meshlets.push_back(meshlet);
+    }
+}
+
+
+bool meshlet::is_backfacing(const Meshlet& meshlet, const Vec3 camera_position) {
+    // A face with normal n is back facing from the camera when dot(n, p - camera) >= 0 for its points p. For every n
+    // within the cone that holds when the direction to p is within 90 degrees minus the cone angle of the axis,
+    // i.e. dot(axis, normalized(p - camera)) >= sin(cone angle). Bounding that over the sphere gives the test below.
+    const Vec3 to_center = meshlet.sphere.center - camera_position;
+
+    return math::dot(to_center, meshlet.cone_axis) >=
+           (meshlet.cone_cutoff * math::magnitude(to_center)) + (meshlet.sphere.radius * (1.f + meshlet.cone_cutoff));
+}
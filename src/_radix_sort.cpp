@@ -0,0 +1,80 @@
+#include "_radix_sort.h"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+
+
+u32 radix_sort::ordered_bits(const f32 value) {
+    // Positive floats already order like their bit patterns. Negative ones order in reverse and below every positive
+    // one, flipping all of their bits does both.
+    const u32 bits = std::bit_cast<u32>(value);
+    const u32 mask = (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+    return bits ^ mask;
+}
+
+
+void radix_sort::sort(const std::span<u64> keys,
+                      const std::span<u32> values,
+                      const std::span<u64> scratch_keys,
+                      const std::span<u32> scratch_values) {
+    const usize count = keys.size();
+    assert(values.size() == count);
+    assert(scratch_keys.size() >= count && scratch_values.size() >= count);
+
+    constexpr usize num_passes = sizeof(u64);
+    constexpr usize num_buckets = 256;
+
+
+    // Histograms of every byte in a single read of the keys
+    //
+    std::array<std::array<u32, num_buckets>, num_passes> histograms{};
+    for (const u64 key : keys) {
+        for (usize pass = 0; pass < num_passes; ++pass) {
+            ++histograms[pass][(key >> (pass * 8)) & 0xFF];
+        }
+    }
+
+
+    // Scatter, ping-ponging between the keys and the scratch buffers
+    //
+    u64* source_keys = keys.data();
+    u32* source_values = values.data();
+    u64* destination_keys = scratch_keys.data();
+    u32* destination_values = scratch_values.data();
+
+    for (usize pass = 0; pass < num_passes; ++pass) {
+        std::array<u32, num_buckets>& histogram = histograms[pass];
+
+        // Every key lands in the same bucket, the pass wouldn't move anything
+        if (std::find(histogram.begin(), histogram.end(), static_cast<u32>(count)) != histogram.end()) {
+            continue;
+        }
+
+        // Bucket counts to bucket start offsets
+        u32 offset = 0;
+        for (u32& bucket : histogram) {
+            const u32 bucket_count = bucket;
+            bucket = offset;
+            offset += bucket_count;
+        }
+
+        const usize shift = pass * 8;
+        for (usize index = 0; index < count; ++index) {
+            const u64 key = source_keys[index];
+            const u32 destination = histogram[(key >> shift) & 0xFF]++;
+
+            destination_keys[destination] = key;
+            destination_values[destination] = source_values[index];
+        }
+
+        std::swap(source_keys, destination_keys);
+        std::swap(source_values, destination_values);
+    }
+
+    // An odd number of passes left the result in the scratch buffers
+    if (source_keys != keys.data()) {
+        std::copy_n(source_keys, count, keys.data());
+        std::copy_n(source_values, count, values.data());
+    }
+}
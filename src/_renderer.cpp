@@ -1,8 +1,16 @@
 #include "_renderer.h"
 
 #include "_ecs.h"
+#include "_simd.h"
 #include "_window.h"
 
+#include <algorithm>
+
+
+// Triangle corners are snapped to 28.4 fixed point, 1/16th pixel precision
+constexpr i32 subpixel_bits = 4;
+constexpr i32 subpixel_steps = 1 << subpixel_bits;
+
 
 Render_System::Render_System(Registry& registry)
     : window(registry.get<Window_System>()) {
@@ -12,7 +20,7 @@ Render_System::Render_System(Registry& registry)
 void Render_System::draw_grid(const i32 x_step, const i32 y_step, const Color color) const {
     for (i32 y = 0; y < window.height; y += y_step) {
         for (i32 x = 0; x < window.width; x += x_step) {
-            window.set_pixel(x, y, color);
+            window.set_background_pixel(x, y, color);
         }
     }
 }
@@ -49,8 +57,7 @@ void Render_System::draw_line(const Vec2i from, const Vec2i to, const Color colo
 
     Vec2 current_coord{static_cast<f32>(from.x), static_cast<f32>(from.y)};
 
-    // NOTE: It is important that loop condition is <= and not <, or we are missing the last pixel, creating artifacts
-    // when drawing triangles
+    // NOTE: Loop condition is <= so that both end points are drawn
     for (i32 i = 0; i <= largest_side_length; ++i) {
         const Vec2i screen_coord{
             .x = static_cast<i32>(current_coord.x),
@@ -65,123 +72,324 @@ void Render_System::draw_line(const Vec2i from, const Vec2i to, const Color colo
 
 
 void Render_System::draw_triangle_wireframe(const Triangle& triangle, const Color color) const {
-    draw_line(triangle[0], triangle[1], color);
-    draw_line(triangle[1], triangle[2], color);
-    draw_line(triangle[2], triangle[0], color);
+    const Vec2i corner_a = static_cast<Vec2i>(triangle[0]);
+    const Vec2i corner_b = static_cast<Vec2i>(triangle[1]);
+    const Vec2i corner_c = static_cast<Vec2i>(triangle[2]);
+
+    draw_line(corner_a, corner_b, color);
+    draw_line(corner_b, corner_c, color);
+    draw_line(corner_c, corner_a, color);
 }
 
 
 void Render_System::draw_triangle_filled(const Triangle& triangle, const Color color) const {
-    // Draw triangle with flat bottom from top to bottom
-    auto draw_bottom_flat = [this, color](const Triangle& tri) -> void {
-        const Vec2i corner_a = tri[0]; // top
-        const Vec2i corner_b = tri[1]; // bottom 0
-        const Vec2i corner_c = tri[2]; // bottom 1
-
-        const Vec2 inverse_slopes{
-            static_cast<f32>(corner_b.x - corner_a.x) / static_cast<f32>(corner_b.y - corner_a.y),
-            static_cast<f32>(corner_c.x - corner_a.x) / static_cast<f32>(corner_c.y - corner_a.y),
-        };
+    Triangle_Setup setup;
+    if (!setup_triangle(triangle, Vec2i::zeroed(), Vec2i{window.width - 1, window.height - 1}, setup)) {
+        return;
+    }
 
-        Vec2 current_xs_f32s = Vec2::splat(static_cast<f32>(corner_a.x));
+    Color* row = &window.color_buffer[setup.bounds_min.y * window.color_buffer_pitch];
 
-        for (i32 scanline_y = corner_a.y; scanline_y <= corner_b.y; ++scanline_y) {
-            const Vec2i current_xs_i32 = static_cast<Vec2i>(current_xs_f32s);
+    for (i32 y = setup.bounds_min.y; y <= setup.bounds_max.y; ++y) {
+        std::array<i64, 3> w;
+        for (usize edge = 0; edge < 3; ++edge) {
+            w[edge] = setup.w_origin[edge] + (static_cast<i64>(y - setup.bounds_min.y) * setup.w_step_y[edge]);
+        }
+        i32 x = setup.bounds_min.x;
 
-            draw_line({current_xs_i32[0], scanline_y},
-                      {current_xs_i32[1], scanline_y},
-                      color
-                      );
+        // Skip to the first covered pixel. Any negative edge value sets the sign bit of the union.
+        while (x <= setup.bounds_max.x && (w[0] | w[1] | w[2]) < 0) {
+            for (usize edge = 0; edge < 3; ++edge) w[edge] += setup.w_step_x[edge];
+            ++x;
+        }
 
-            current_xs_f32s += inverse_slopes;
+        // The triangle is convex, so the covered pixels of a row form a single span
+        const i32 span_start = x;
+        while (x <= setup.bounds_max.x && (w[0] | w[1] | w[2]) >= 0) {
+            for (usize edge = 0; edge < 3; ++edge) w[edge] += setup.w_step_x[edge];
+            ++x;
         }
-    };
 
-    // Draw triangle with flat bottom from bottom to top
-    auto draw_top_flat = [this, color](const Triangle& tri) -> void {
-        const Vec2i corner_a = tri[0]; // top 0
-        const Vec2i corner_b = tri[1]; // top 1
-        const Vec2i corner_c = tri[2]; // bottom
+        std::fill(row + span_start, row + x, color);
 
-        const Vec2 inverse_slopes{
-            static_cast<f32>(corner_c.x - corner_a.x) / static_cast<f32>(corner_c.y - corner_a.y),
-            static_cast<f32>(corner_c.x - corner_b.x) / static_cast<f32>(corner_c.y - corner_b.y),
-        };
+        if (span_start < x) {
+            const i32 block_y = y / Window_System::depth_block_size;
+            for (i32 block_x = span_start / Window_System::depth_block_size;
+                 block_x <= (x - 1) / Window_System::depth_block_size;
+                 ++block_x) {
+                window.mark_color_block_dirty(block_x, block_y);
+            }
+        }
+
+        row += window.color_buffer_pitch;
+    }
+}
+
+
+void Render_System::draw_triangle_filled(const Raster_Triangle& triangle, const Color color) const {
+    draw_triangle_filled(triangle, color, Vec2i::zeroed(), Vec2i{window.width - 1, window.height - 1});
+}
 
-        Vec2 current_xs_f32s = Vec2::splat(static_cast<f32>(corner_c.x));
 
-        for (i32 scanline_y = corner_c.y; scanline_y > corner_a.y; --scanline_y) {
-            const Vec2i current_xs_i32 = static_cast<Vec2i>(current_xs_f32s);
+void Render_System::draw_triangle_filled(const Raster_Triangle& triangle,
+                                         const Color color,
+                                         const Vec2i clip_min,
+                                         const Vec2i clip_max) const {
+    Triangle_Setup setup;
+    if (!setup_triangle(triangle.corners, clip_min, clip_max, setup)) {
+        return;
+    }
+
+    // Depth is affine in screen space, interpolate it as a plane over the bounding box
+    std::array<f32, 3> depths = triangle.depths;
+    if (setup.is_winding_flipped) {
+        std::swap(depths[1], depths[2]);
+    }
+
+    f32 depth_step_x = 0.f;
+    f32 depth_step_y = 0.f;
+    f32 depth_origin = 0.f; // at the center of pixel bounds_min
+    for (usize corner = 0; corner < 3; ++corner) {
+        depth_step_x += setup.barycentric_step_x[corner] * depths[corner];
+        depth_step_y += setup.barycentric_step_y[corner] * depths[corner];
+        depth_origin += setup.barycentric_origin[corner] * depths[corner];
+    }
 
-            draw_line({current_xs_i32[0], scanline_y},
-                      {current_xs_i32[1], scanline_y},
-                      color
-                      );
+    const f32 triangle_min_depth = std::min({depths[0], depths[1], depths[2]});
+    const f32 triangle_max_depth = std::max({depths[0], depths[1], depths[2]});
 
-            current_xs_f32s -= inverse_slopes;
+    // Per lane offsets for evaluating simd::width pixels of a row at once
+    std::array<simd::I32_Lanes, 3> w_lane_offsets;
+    for (usize edge = 0; edge < 3; ++edge) {
+        w_lane_offsets[edge] = simd::sequence(0, setup.w_step_x[edge]);
+    }
+    const simd::F32_Lanes depth_lane_offsets = simd::sequence(0.f, depth_step_x);
+    const simd::I32_Lanes lane_offsets = simd::sequence(0, 1);
+    const simd::I32_Lanes color_lanes = simd::splat(static_cast<i32>(color.hex));
+
+    // Returns whether any lane was written
+    auto shade_lanes = [&](f32* depth_dst,
+                           u32* color_dst,
+                           const simd::Mask covered,
+                           const simd::F32_Lanes depths,
+                           const bool is_depth_test_needed) -> bool {
+        const simd::F32_Lanes old_depths = simd::load(depth_dst);
+        const simd::Mask passed = is_depth_test_needed ? covered & simd::less_than(depths, old_depths) : covered;
+        if (!simd::any(passed)) {
+            return false;
         }
+        simd::store(depth_dst, simd::select(passed, depths, old_depths));
+        simd::store(color_dst, simd::select(passed, color_lanes, simd::load(color_dst)));
+        return true;
     };
 
 
-    Vec2i corner_a = triangle[0];
-    Vec2i corner_b = triangle[1];
-    Vec2i corner_c = triangle[2];
+    // Walk the bounding box in depth blocks, so that the coarse depth can reject whole blocks
+    constexpr i32 block_size = Window_System::depth_block_size;
+    const Vec2i first_block = setup.bounds_min / block_size;
+    const Vec2i last_block = setup.bounds_max / block_size;
+
+    for (i32 block_y = first_block.y; block_y <= last_block.y; ++block_y) {
+        for (i32 block_x = first_block.x; block_x <= last_block.x; ++block_x) {
+            const usize block_index = (block_y * window.num_depth_blocks_x) + block_x;
+
+            // Every pixel in the block is already closer than the closest point of the triangle
+            if (triangle_min_depth >= window.depth_block_max[block_index]) {
+                continue;
+            }
+
+            const Vec2i block_origin{block_x * block_size, block_y * block_size};
+
+            // Reject the block if it is entirely outside of any edge. Edge functions are linear, so the largest
+            // value within the block is at one of its corners.
+            std::array<i32, 3> w_block;
+            bool is_block_outside = false;
+            for (usize edge = 0; edge < 3; ++edge) {
+                w_block[edge] = edge_value_at(setup, edge, block_origin);
+
+                const i32 w_max = w_block[edge] +
+                                  std::max(setup.w_step_x[edge] * (block_size - 1), 0) +
+                                  std::max(setup.w_step_y[edge] * (block_size - 1), 0);
+                is_block_outside |= w_max < 0;
+            }
+            if (is_block_outside) {
+                continue;
+            }
+
+            // The whole triangle is in front of everything in the block
+            const bool is_depth_test_needed = triangle_max_depth >= window.depth_block_min[block_index];
+
+            const i32 start_y = std::max(block_origin.y, setup.bounds_min.y);
+            const i32 end_y = std::min(block_origin.y + block_size - 1, setup.bounds_max.y);
+            bool is_block_written = false;
+
+            for (i32 y = start_y; y <= end_y; ++y) {
+                const i32 row_offset_y = y - setup.bounds_min.y;
+                u32* const color_row = reinterpret_cast<u32*>(&window.color_buffer[y * window.color_buffer_pitch]);
+                f32* const depth_row = &window.depth_buffer[y * window.width];
+
+                for (i32 x = block_origin.x; x < block_origin.x + block_size; x += static_cast<i32>(simd::width)) {
+                    const i32 lanes_start_x = std::max(x, setup.bounds_min.x);
+                    const i32 lanes_end_x = std::min(x + static_cast<i32>(simd::width) - 1, setup.bounds_max.x);
+                    if (lanes_start_x > lanes_end_x) {
+                        continue;
+                    }
+
+                    std::array<simd::I32_Lanes, 3> w;
+                    for (usize edge = 0; edge < 3; ++edge) {
+                        w[edge] = simd::splat(edge_value_at(setup, edge, Vec2i{x, y})) + w_lane_offsets[edge];
+                    }
+                    simd::Mask covered = simd::greater_equal_zero(w[0] | w[1] | w[2]);
+                    if (!simd::any(covered)) {
+                        continue;
+                    }
+
+                    const f32 depth_start = depth_origin +
+                                            (static_cast<f32>(x - setup.bounds_min.x) * depth_step_x) +
+                                            (static_cast<f32>(row_offset_y) * depth_step_y);
+                    const simd::F32_Lanes depths = simd::splat(depth_start) + depth_lane_offsets;
+
+                    if (lanes_start_x == x && lanes_end_x == x + static_cast<i32>(simd::width) - 1) {
+                        is_block_written |= shade_lanes(&depth_row[x], &color_row[x], covered, depths,
+                                                        is_depth_test_needed);
+                        continue;
+                    }
+
+                    // Lanes partially outside the bounding box. Go through a full width copy of the lanes that are
+                    // inside, so that no memory outside of it is touched.
+                    const simd::I32_Lanes lane_xs = simd::splat(x) + lane_offsets;
+                    covered = covered &
+                              simd::greater_equal_zero(lane_xs - simd::splat(lanes_start_x)) &
+                              simd::greater_equal_zero(simd::splat(lanes_end_x) - lane_xs);
+
+                    const usize first_lane = lanes_start_x - x;
+                    const usize num_lanes = lanes_end_x - lanes_start_x + 1;
+                    std::array<f32, simd::width> depth_lanes{};
+                    std::array<u32, simd::width> color_lanes_copy{};
+                    std::copy_n(&depth_row[lanes_start_x], num_lanes, &depth_lanes[first_lane]);
+                    std::copy_n(&color_row[lanes_start_x], num_lanes, &color_lanes_copy[first_lane]);
+
+                    if (shade_lanes(depth_lanes.data(), color_lanes_copy.data(), covered, depths,
+                                    is_depth_test_needed)) {
+                        std::copy_n(&depth_lanes[first_lane], num_lanes, &depth_row[lanes_start_x]);
+                        std::copy_n(&color_lanes_copy[first_lane], num_lanes, &color_row[lanes_start_x]);
+                        is_block_written = true;
+                    }
+                }
+            }
+
+            if (is_block_written) {
+                window.update_depth_block(block_x, block_y);
+                window.mark_color_block_dirty(block_x, block_y);
+            }
+        }
+    }
+}
+
+
+bool Render_System::setup_triangle(const Triangle& triangle,
+                                   const Vec2i clip_min,
+                                   const Vec2i clip_max,
+                                   Triangle_Setup& setup) const {
+    for (const Vec2 corner : triangle) {
+        if (!(std::abs(corner.x) <= max_raster_coordinate && std::abs(corner.y) <= max_raster_coordinate)) {
+            return false;
+        }
+    }
 
-    // Sort by y. Positive y is down here. A->B->C, where A is the lowest Y-value.
-    if (corner_a.y > corner_b.y) std::swap(corner_a, corner_b);
-    if (corner_a.y > corner_c.y) std::swap(corner_a, corner_c);
-    if (corner_b.y > corner_c.y) std::swap(corner_b, corner_c);
+    // Snap to 28.4 fixed point
+    auto to_fixed_point = [](const Vec2 corner) -> Vec2i {
+        return Vec2i{
+            static_cast<i32>(std::lround(corner.x * static_cast<f32>(subpixel_steps))),
+            static_cast<i32>(std::lround(corner.y * static_cast<f32>(subpixel_steps))),
+        };
+    };
 
+    const Vec2i corner_a = to_fixed_point(triangle[0]);
+    Vec2i corner_b = to_fixed_point(triangle[1]);
+    Vec2i corner_c = to_fixed_point(triangle[2]);
 
-    // Avoid division by zero in draw_top_flat
-    if (corner_b.y == corner_c.y) {
-        draw_bottom_flat(Triangle{corner_a, corner_b, corner_c});
-        return;
+    // Twice the signed area, in square subpixels. Triangles that are degenerate after snapping cover no pixels.
+    i64 area = (static_cast<i64>(corner_b.x - corner_a.x) * (corner_c.y - corner_a.y)) -
+               (static_cast<i64>(corner_b.y - corner_a.y) * (corner_c.x - corner_a.x));
+    if (area == 0) {
+        return false;
     }
 
-    // Avoid division by zero in draw_bottom_flat
-    if (corner_a.y == corner_b.y) {
-        draw_top_flat(Triangle{corner_a, corner_b, corner_c});
-        return;
+    // Make the winding consistent (clockwise on screen) so that a pixel is covered when all edge functions are >= 0
+    setup.is_winding_flipped = area < 0;
+    if (setup.is_winding_flipped) {
+        std::swap(corner_b, corner_c);
+        area = -area;
     }
 
 
-    // NOTE/TODO: Division by zero may be possible when triangle is directly
-    // aligned with the camera view corner_a.y == corner_b.y == corner_c.y
+    // Bounding box of the pixels whose centers can be covered, clipped to the clip rect
+    constexpr i32 half_subpixel_steps = subpixel_steps / 2;
+    const i32 min_x = std::min({corner_a.x, corner_b.x, corner_c.x}) - half_subpixel_steps;
+    const i32 min_y = std::min({corner_a.y, corner_b.y, corner_c.y}) - half_subpixel_steps;
+    const i32 max_x = std::max({corner_a.x, corner_b.x, corner_c.x}) - half_subpixel_steps;
+    const i32 max_y = std::max({corner_a.y, corner_b.y, corner_c.y}) - half_subpixel_steps;
 
+    setup.bounds_min = Vec2i{
+        .x = std::max((min_x + subpixel_steps - 1) >> subpixel_bits, clip_min.x),
+        .y = std::max((min_y + subpixel_steps - 1) >> subpixel_bits, clip_min.y),
+    };
+    setup.bounds_max = Vec2i{
+        .x = std::min(max_x >> subpixel_bits, clip_max.x),
+        .y = std::min(max_y >> subpixel_bits, clip_max.y),
+    };
+    if (setup.bounds_min.x > setup.bounds_max.x || setup.bounds_min.y > setup.bounds_max.y) {
+        return false;
+    }
 
-    Vec2i triangle_midpoint;
-    {
-        triangle_midpoint.x =
-            static_cast<i32>(
-                static_cast<f32>((corner_c.x - corner_a.x) * (corner_b.y - corner_a.y))
-                /
-                static_cast<f32>(corner_c.y - corner_a.y)
-            )
-            + corner_a.x;
 
-        triangle_midpoint.y = corner_b.y;
-    }
+    // Edge 0 is opposite of corner a, edge 1 of corner b and edge 2 of corner c
+    const std::array<Vec2i, 3> edge_from{corner_b, corner_c, corner_a};
+    const std::array<Vec2i, 3> edge_to{corner_c, corner_a, corner_b};
 
-    draw_bottom_flat(Triangle{corner_a, corner_b, triangle_midpoint});
-    draw_top_flat(Triangle{corner_b, triangle_midpoint, corner_c});
-}
+    const Vec2i origin_sample{
+        (setup.bounds_min.x << subpixel_bits) + half_subpixel_steps,
+        (setup.bounds_min.y << subpixel_bits) + half_subpixel_steps,
+    };
 
+    const f32 inverse_area = 1.f / static_cast<f32>(area);
 
-Vec2 Render_System::project_point(const Vec3 point, const f32 fov_factor) {
-    // At this point, everything will be presented 1:1 onto the screen
-    // If the point's position was (1, 1, 1) and we present it as is, the final pixel location will be (1, 1)
-    Vec2 pixel_coord{point.x, point.y};
+    for (usize edge = 0; edge < 3; ++edge) {
+        const Vec2i from = edge_from[edge];
+        const Vec2i delta = edge_to[edge] - from;
 
-    // With a fov factor of 100, the final pixel location of that same point will be (100, 100)
-    pixel_coord *= fov_factor;
+        const i64 w = (static_cast<i64>(delta.x) * (origin_sample.y - from.y)) -
+                      (static_cast<i64>(delta.y) * (origin_sample.x - from.x));
+
+        // Top-left fill rule: pixel centers exactly on an edge belong to the triangle only if the edge is a top edge
+        // (horizontal, with the triangle below it) or a left edge. Every pixel on an edge shared by two triangles is
+        // drawn exactly once.
+        const bool is_top_left_edge = (delta.y == 0 && delta.x > 0) || delta.y < 0;
+        const i64 bias = is_top_left_edge ? 0 : -1;
+
+        // Stepping one pixel moves subpixel_steps subpixels, which changes the edge function by a multiple of
+        // subpixel_steps. Dividing that factor out (rounding down, so the sign is preserved) steps by whole subpixels.
+        setup.w_origin[edge] = (w + bias) >> subpixel_bits;
+        setup.w_step_x[edge] = -delta.y;
+        setup.w_step_y[edge] = delta.x;
+
+        // The unbiased edge function normalized by the area is the barycentric weight of the opposite corner
+        setup.barycentric_origin[edge] = static_cast<f32>(w) * inverse_area;
+        setup.barycentric_step_x[edge] = static_cast<f32>(-delta.y * subpixel_steps) * inverse_area;
+        setup.barycentric_step_y[edge] = static_cast<f32>(delta.x * subpixel_steps) * inverse_area;
+    }
+
+    return true;
+}
 
-    // Larger z-value == smaller displacement from the origin
-    const f32 z = point.z != 0 ? point.z : 0.01f;
-    pixel_coord /= z;
 
-    // Positive y up
-    pixel_coord.y = -pixel_coord.y;
+i32 Render_System::edge_value_at(const Triangle_Setup& setup, const usize edge, const Vec2i pixel) {
+    const i64 w = setup.w_origin[edge] +
+                  (static_cast<i64>(pixel.x - setup.bounds_min.x) * setup.w_step_x[edge]) +
+                  (static_cast<i64>(pixel.y - setup.bounds_min.y) * setup.w_step_y[edge]);
 
-    return pixel_coord;
+    // Far away from the edge only the sign matters. Clamping leaves enough headroom to keep stepping across a block.
+    constexpr i64 w_limit = 1 << 30;
+    return static_cast<i32>(std::clamp(w, -w_limit, w_limit));
 }
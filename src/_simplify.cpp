@@ -0,0 +1,310 @@
+#include "_simplify.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <queue>
+
+
+namespace simplify {
+
+
+// Symmetric 4x4 matrix, sum of squared distances to a set of planes. Kept in double precision, the terms of large
+// meshes cancel out badly in single precision.
+struct Quadric {
+    f64 xx = 0, xy = 0, xz = 0, xw = 0;
+    f64 yy = 0, yz = 0, yw = 0;
+    f64 zz = 0, zw = 0;
+    f64 ww = 0;
+
+    static Quadric from_plane(const Vec3 normal, const f64 distance) {
+        const f64 a = normal.x;
+        const f64 b = normal.y;
+        const f64 c = normal.z;
+        const f64 d = distance;
+
+        return Quadric{
+            a * a, a * b, a * c, a * d,
+            b * b, b * c, b * d,
+            c * c, c * d,
+            d * d,
+        };
+    }
+
+    void operator+=(const Quadric& other) {
+        xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw;
+        yy += other.yy; yz += other.yz; yw += other.yw;
+        zz += other.zz; zw += other.zw;
+        ww += other.ww;
+    }
+
+    friend Quadric operator+(Quadric a, const Quadric& b) {
+        a += b;
+        return a;
+    }
+
+    // p^T Q p with p = {point, 1}
+    f64 evaluate(const Vec3 point) const {
+        const f64 x = point.x;
+        const f64 y = point.y;
+        const f64 z = point.z;
+
+        return (xx * x * x) + (2 * xy * x * y) + (2 * xz * x * z) + (2 * xw * x) +
+               (yy * y * y) + (2 * yz * y * z) + (2 * yw * y) +
+               (zz * z * z) + (2 * zw * z) +
+               ww;
+    }
+};
+
+
+// Moves from onto to
+struct Collapse {
+    f64 cost;
+    u32 from;
+    u32 to;
+    u32 from_version;
+    u32 to_version;
+
+    bool operator>(const Collapse& other) const { return cost > other.cost; }
+};
+
+
+static Vec3 face_normal(const std::span<const Vec3> vertices, const Face_Vertex_Indices& face) {
+    return math::cross(vertices[face[1]] - vertices[face[0]], vertices[face[2]] - vertices[face[0]]);
+}
+
+
+f32 simplify(const std::span<const Vec3> vertices,
+             const std::span<const Face_Vertex_Indices> faces,
+             const usize target_num_faces,
+             std::vector<Face_Vertex_Indices>& simplified_faces,
+             std::vector<u32>& simplified_face_origins) {
+
+    const usize num_vertices = vertices.size();
+
+    std::vector<Face_Vertex_Indices> working_faces(faces.begin(), faces.end());
+    std::vector<bool> is_face_alive(faces.size(), true);
+    usize num_alive_faces = faces.size();
+
+    std::vector<std::vector<u32>> vertex_faces(num_vertices);   // may list dead faces
+    for (usize face_index = 0; face_index < faces.size(); ++face_index) {
+        for (const u16 vertex_index : faces[face_index]) {
+            vertex_faces[vertex_index].push_back(static_cast<u32>(face_index));
+        }
+    }
+
+
+    // Vertex quadrics, sum of the planes of the surrounding faces. Unweighted, so that the square root of a collapse
+    // cost bounds the distance to every original plane involved.
+    //
+    std::vector<Quadric> quadrics(num_vertices);
+    for (const Face_Vertex_Indices& face : faces) {
+        const Vec3 normal = math::normalized(face_normal(vertices, face));
+        if (math::sq_magnitude(normal) == 0.f) {
+            continue;
+        }
+
+        const Quadric quadric = Quadric::from_plane(normal, -math::dot(normal, vertices[face[0]]));
+
+        for (const u16 vertex_index : face) {
+            quadrics[vertex_index] += quadric;
+        }
+    }
+
+
+    // Border vertices, on an edge that only one face uses, stay in place so that open meshes keep their outline
+    //
+    std::vector<bool> is_vertex_locked(num_vertices, false);
+    {
+        std::vector<std::pair<u32, u32>> edges;
+        edges.reserve(faces.size() * 3);
+        for (const Face_Vertex_Indices& face : faces) {
+            for (usize corner = 0; corner < 3; ++corner) {
+                const u32 a = face[corner];
+                const u32 b = face[(corner + 1) % 3];
+                edges.emplace_back(std::min(a, b), std::max(a, b));
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+
+        for (usize edge_index = 0; edge_index < edges.size(); ) {
+            usize edge_end = edge_index + 1;
+            while (edge_end < edges.size() && edges[edge_end] == edges[edge_index]) {
+                ++edge_end;
+            }
+            if (edge_end - edge_index == 1) {
+                is_vertex_locked[edges[edge_index].first] = true;
+                is_vertex_locked[edges[edge_index].second] = true;
+            }
+            edge_index = edge_end;
+        }
+    }
+
+
+    std::vector<bool> is_vertex_alive(num_vertices, true);
+    std::vector<u32> vertex_versions(num_vertices, 0);   // bumped whenever collapse costs around the vertex change
+
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<>> collapses;
+
+    auto push_collapse = [&](const u32 from, const u32 to) -> void {
+        if (is_vertex_locked[from]) {
+            return;
+        }
+        collapses.push(Collapse{
+            .cost = (quadrics[from] + quadrics[to]).evaluate(vertices[to]),
+            .from = from,
+            .to = to,
+            .from_version = vertex_versions[from],
+            .to_version = vertex_versions[to],
+        });
+    };
+
+    auto push_collapses_around = [&](const u32 vertex_index) -> void {
+        for (const u32 face_index : vertex_faces[vertex_index]) {
+            if (!is_face_alive[face_index]) {
+                continue;
+            }
+            for (const u16 other_vertex_index : working_faces[face_index]) {
+                if (other_vertex_index != vertex_index) {
+                    push_collapse(vertex_index, other_vertex_index);
+                    push_collapse(other_vertex_index, vertex_index);
+                }
+            }
+        }
+    };
+
+    for (u32 vertex_index = 0; vertex_index < num_vertices; ++vertex_index) {
+        for (const u32 face_index : vertex_faces[vertex_index]) {
+            for (const u16 other_vertex_index : working_faces[face_index]) {
+                if (other_vertex_index != vertex_index) {
+                    push_collapse(vertex_index, other_vertex_index);
+                }
+            }
+        }
+    }
+
+
+    std::vector<u32> from_neighbours;
+    std::vector<u32> to_neighbours;
+
+    auto gather_neighbours = [&](const u32 vertex_index, std::vector<u32>& neighbours) -> void {
+        neighbours.clear();
+        for (const u32 face_index : vertex_faces[vertex_index]) {
+            if (!is_face_alive[face_index]) {
+                continue;
+            }
+            for (const u16 other_vertex_index : working_faces[face_index]) {
+                if (other_vertex_index != vertex_index) {
+                    neighbours.push_back(other_vertex_index);
+                }
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+    };
+
+    f64 max_cost = 0.0;
+
+    while (num_alive_faces > target_num_faces && !collapses.empty()) {
+        const Collapse collapse = collapses.top();
+        collapses.pop();
+
+        if (!is_vertex_alive[collapse.from] || !is_vertex_alive[collapse.to] ||
+            collapse.from_version != vertex_versions[collapse.from] ||
+            collapse.to_version != vertex_versions[collapse.to]) {
+            continue;
+        }
+
+
+        // Link condition, the end points may only share the neighbours opposite of the edge. Anything else would pinch
+        // the surface into a non-manifold one.
+        //
+        usize num_shared_faces = 0;
+        for (const u32 face_index : vertex_faces[collapse.from]) {
+            if (is_face_alive[face_index] &&
+                std::find(working_faces[face_index].begin(), working_faces[face_index].end(), collapse.to) !=
+                working_faces[face_index].end()) {
+                ++num_shared_faces;
+            }
+        }
+        if (num_shared_faces == 0) {
+            continue;
+        }
+
+        gather_neighbours(collapse.from, from_neighbours);
+        gather_neighbours(collapse.to, to_neighbours);
+
+        usize num_shared_neighbours = 0;
+        for (const u32 neighbour : from_neighbours) {
+            num_shared_neighbours += std::binary_search(to_neighbours.begin(), to_neighbours.end(), neighbour);
+        }
+        if (num_shared_neighbours != num_shared_faces) {
+            continue;
+        }
+
+
+        // Reject collapses that would turn a remaining face over
+        //
+        bool is_flipping = false;
+        for (const u32 face_index : vertex_faces[collapse.from]) {
+            const Face_Vertex_Indices& face = working_faces[face_index];
+            if (!is_face_alive[face_index] || std::find(face.begin(), face.end(), collapse.to) != face.end()) {
+                continue;
+            }
+
+            Face_Vertex_Indices collapsed_face = face;
+            std::replace(collapsed_face.begin(), collapsed_face.end(), static_cast<u16>(collapse.from),
+                         static_cast<u16>(collapse.to));
+
+            if (math::dot(face_normal(vertices, face), face_normal(vertices, collapsed_face)) <= 0.f) {
+                is_flipping = true;
+                break;
+            }
+        }
+        if (is_flipping) {
+            continue;
+        }
+
+
+        // Collapse
+        //
+        for (const u32 face_index : vertex_faces[collapse.from]) {
+            if (!is_face_alive[face_index]) {
+                continue;
+            }
+
+            Face_Vertex_Indices& face = working_faces[face_index];
+            if (std::find(face.begin(), face.end(), collapse.to) != face.end()) {
+                is_face_alive[face_index] = false;
+                --num_alive_faces;
+                continue;
+            }
+
+            std::replace(face.begin(), face.end(), static_cast<u16>(collapse.from), static_cast<u16>(collapse.to));
+            vertex_faces[collapse.to].push_back(face_index);
+        }
+
+        quadrics[collapse.to] += quadrics[collapse.from];
+        is_vertex_alive[collapse.from] = false;
+        ++vertex_versions[collapse.to];
+
+        max_cost = std::max(max_cost, collapse.cost);
+
+        push_collapses_around(collapse.to);
+    }
+
+
+    simplified_faces.clear();
+    simplified_face_origins.clear();
+    for (usize face_index = 0; face_index < working_faces.size(); ++face_index) {
+        if (is_face_alive[face_index]) {
+            simplified_faces.push_back(working_faces[face_index]);
+            simplified_face_origins.push_back(static_cast<u32>(face_index));
+        }
+    }
+
+    return static_cast<f32>(std::sqrt(max_cost));
+}
+
+
+} // namespace simplify
@@ -1,6 +1,8 @@
 #include "_tga.h"
 #include "_common.h"
 
+#include <cassert>
+#include <cstring>
 #include <sstream>
 
 namespace tga
@@ -79,4 +81,25 @@ std::string to_string(const Header_View& header) {
 }
 
 
+void decode_pixels(const Header_View& header, const std::span<const u8> data, const std::span<Color> pixels) {
+    const usize bytes_per_pixel = header.bytes_per_pixel();
+    const usize num_pixels = header.num_pixels();
+    assert(bytes_per_pixel == 3 || bytes_per_pixel == 4);
+    assert(pixels.size() >= num_pixels && data.size() >= header.offset_image() + header.packed_byte_size_image());
+
+    const u8* src = &data[header.offset_image()];
+
+    // Same BGRA byte order as Color, a plain copy
+    if (bytes_per_pixel == sizeof(Color)) {
+        std::memcpy(pixels.data(), src, num_pixels * sizeof(Color));
+        return;
+    }
+
+    for (usize px_idx = 0; px_idx < num_pixels; ++px_idx) {
+        const u8* src_pixel = &src[px_idx * bytes_per_pixel];
+        pixels[px_idx] = Color{.b = src_pixel[0], .g = src_pixel[1], .r = src_pixel[2], .a = 0xFF};
+    }
+}
+
+
 }
@@ -0,0 +1,217 @@
+#include "_tile_raster.h"
+
+#include "_frame_arena.h"
+#include "_renderer.h"
+#include "_window.h"
+
+#include <algorithm>
+
+
+// Depth blocks must not straddle tiles, their coarse depth is updated by whichever thread owns the tile
+static_assert(Tile_Raster_System::tile_size % Window_System::depth_block_size == 0);
+
+
+Tile_Raster_System::Tile_Raster_System(Registry& reg, const u32 num_worker_threads)
+    : window(reg.get<Window_System>()),
+      renderer(reg.get<Render_System>()),
+      frame_arena(reg.get<Frame_Arena_System>().get_arena()),
+      num_tiles_x((window.width + tile_size - 1) / tile_size),
+      num_tiles_y((window.height + tile_size - 1) / tile_size),
+      next_tile_index(0),
+      job_generation(0),
+      num_workers_running(0),
+      is_shutting_down(false) {
+
+    workers.reserve(num_worker_threads);
+    for (u32 worker_index = 0; worker_index < num_worker_threads; ++worker_index) {
+        workers.emplace_back(&Tile_Raster_System::worker_loop, this);
+    }
+}
+
+
+Tile_Raster_System::~Tile_Raster_System() {
+    {
+        std::lock_guard lock{mutex};
+        is_shutting_down = true;
+    }
+    job_started.notify_all();
+
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+
+u32 Tile_Raster_System::default_num_worker_threads() {
+    // The calling thread rasterizes tiles as well
+    const u32 num_hardware_threads = std::thread::hardware_concurrency();
+    return num_hardware_threads > 1 ? num_hardware_threads - 1 : 0;
+}
+
+
+void Tile_Raster_System::draw_triangles_filled(const std::span<const Raster_Triangle> triangles,
+                                               const std::span<const Color> colors,
+                                               const std::span<const u32> draw_order) {
+    assert(triangles.size() == colors.size());
+    assert(draw_order.empty() || draw_order.size() == triangles.size());
+
+    job_triangles = triangles;
+    job_colors = colors;
+    job_draw_order = draw_order;
+    bin_triangles();
+
+    next_tile_index.store(0, std::memory_order_relaxed);
+
+    if (!workers.empty()) {
+        std::lock_guard lock{mutex};
+        num_workers_running = static_cast<u32>(workers.size());
+        ++job_generation;
+    }
+    job_started.notify_all();
+
+    rasterize_tiles();
+
+    if (!workers.empty()) {
+        std::unique_lock lock{mutex};
+        job_finished.wait(lock, [this]() -> bool { return num_workers_running == 0; });
+    }
+
+    job_triangles = {};
+    job_colors = {};
+    job_draw_order = {};
+    bin_starts = {};
+    binned_triangles = {};
+}
+
+
+void Tile_Raster_System::bin_triangles() {
+    const usize num_tiles = static_cast<usize>(num_tiles_x) * static_cast<usize>(num_tiles_y);
+
+    // Tiles overlapped by every triangle in draw order, empty for triangles that are off screen
+    struct Tile_Range {
+        Vec2i min;
+        Vec2i max;
+    };
+    const std::span<Tile_Range> tile_ranges = frame_arena.allocate_array<Tile_Range>(job_triangles.size());
+
+    // Counts per tile first, shifted by one so that summing them up in place turns them into the bin starts
+    bin_starts = frame_arena.allocate_array<u32>(num_tiles + 1);
+
+    for (u32 draw_index = 0; draw_index < job_triangles.size(); ++draw_index) {
+        const u32 triangle_index = job_draw_order.empty() ? draw_index : job_draw_order[draw_index];
+        const Triangle& corners = job_triangles[triangle_index].corners;
+
+        const Vec2 min_corner{
+            std::min({corners[0].x, corners[1].x, corners[2].x}),
+            std::min({corners[0].y, corners[1].y, corners[2].y}),
+        };
+        const Vec2 max_corner{
+            std::max({corners[0].x, corners[1].x, corners[2].x}),
+            std::max({corners[0].y, corners[1].y, corners[2].y}),
+        };
+        if (max_corner.x < 0.f || max_corner.y < 0.f ||
+            min_corner.x >= static_cast<f32>(window.width) || min_corner.y >= static_cast<f32>(window.height)) {
+            tile_ranges[draw_index] = Tile_Range{.min = {0, 0}, .max = {-1, -1}};
+            continue;
+        }
+
+        // Conservative pixel bounds, the rasterizer does the exact coverage
+        auto to_pixel = [](const f32 coordinate, const i32 max_pixel) -> i32 {
+            return static_cast<i32>(std::clamp(coordinate, 0.f, static_cast<f32>(max_pixel)));
+        };
+
+        const Vec2i bounds_min{to_pixel(min_corner.x, window.width - 1), to_pixel(min_corner.y, window.height - 1)};
+        const Vec2i bounds_max{to_pixel(max_corner.x, window.width - 1), to_pixel(max_corner.y, window.height - 1)};
+
+        const Tile_Range range{
+            .min = {bounds_min.x / tile_size, bounds_min.y / tile_size},
+            .max = {bounds_max.x / tile_size, bounds_max.y / tile_size},
+        };
+        tile_ranges[draw_index] = range;
+
+        for (i32 tile_y = range.min.y; tile_y <= range.max.y; ++tile_y) {
+            for (i32 tile_x = range.min.x; tile_x <= range.max.x; ++tile_x) {
+                ++bin_starts[(tile_y * num_tiles_x) + tile_x + 1];
+            }
+        }
+    }
+
+    for (usize tile_index = 1; tile_index <= num_tiles; ++tile_index) {
+        bin_starts[tile_index] += bin_starts[tile_index - 1];
+    }
+
+
+    // Bins are filled in draw order, every tile then draws its triangles in that order
+    binned_triangles = frame_arena.allocate_array<u32>(bin_starts[num_tiles]);
+
+    const std::span<u32> bin_ends = frame_arena.allocate_array<u32>(num_tiles);
+    std::copy_n(bin_starts.begin(), num_tiles, bin_ends.begin());
+
+    for (u32 draw_index = 0; draw_index < job_triangles.size(); ++draw_index) {
+        const u32 triangle_index = job_draw_order.empty() ? draw_index : job_draw_order[draw_index];
+        const Tile_Range& range = tile_ranges[draw_index];
+
+        for (i32 tile_y = range.min.y; tile_y <= range.max.y; ++tile_y) {
+            for (i32 tile_x = range.min.x; tile_x <= range.max.x; ++tile_x) {
+                binned_triangles[bin_ends[(tile_y * num_tiles_x) + tile_x]++] = triangle_index;
+            }
+        }
+    }
+}
+
+
+void Tile_Raster_System::rasterize_tiles() {
+    const u32 num_tiles = static_cast<u32>(num_tiles_x * num_tiles_y);
+
+    for (u32 tile_index = next_tile_index.fetch_add(1, std::memory_order_relaxed);
+         tile_index < num_tiles;
+         tile_index = next_tile_index.fetch_add(1, std::memory_order_relaxed)) {
+
+        const u32 bin_start = bin_starts[tile_index];
+        const std::span<const u32> bin = binned_triangles.subspan(bin_start, bin_starts[tile_index + 1] - bin_start);
+        if (bin.empty()) {
+            continue;
+        }
+
+        const Vec2i tile_min{
+            .x = static_cast<i32>(tile_index % num_tiles_x) * tile_size,
+            .y = static_cast<i32>(tile_index / num_tiles_x) * tile_size,
+        };
+        const Vec2i tile_max{
+            .x = std::min(tile_min.x + tile_size, window.width) - 1,
+            .y = std::min(tile_min.y + tile_size, window.height) - 1,
+        };
+
+        for (const u32 triangle_index : bin) {
+            renderer.draw_triangle_filled(job_triangles[triangle_index], job_colors[triangle_index],
+                                          tile_min, tile_max);
+        }
+    }
+}
+
+
+void Tile_Raster_System::worker_loop() {
+    u64 last_job_generation = 0;
+
+    while (true) {
+        {
+            std::unique_lock lock{mutex};
+            job_started.wait(lock, [&]() -> bool {
+                return is_shutting_down || job_generation != last_job_generation;
+            });
+
+            if (is_shutting_down) {
+                return;
+            }
+            last_job_generation = job_generation;
+        }
+
+        rasterize_tiles();
+
+        {
+            std::lock_guard lock{mutex};
+            --num_workers_running;
+        }
+        job_finished.notify_one();
+    }
+}
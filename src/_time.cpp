@@ -7,7 +7,8 @@
 
 Time_System::Time_System()
     : delta_nanoseconds(),
-      delta_seconds(0) {
+      delta_seconds(0),
+      fixed_delta_seconds(0) {
 }
 
 
@@ -23,8 +24,17 @@ void Time_System::update()
 
     delta_nanoseconds = std::chrono::duration_cast<Duration_NanoSeconds>(dt_duration).count();
     delta_seconds = static_cast<f32>(delta_nanoseconds) / static_cast<float>(ns_per_s());
+
+    if (fixed_delta_seconds > 0.f) {
+        delta_seconds = fixed_delta_seconds;
+        delta_nanoseconds = static_cast<u64>(static_cast<f64>(fixed_delta_seconds) * ns_per_s());
+    }
 }
 
 f32 Time_System::get_delta_seconds() const {
     return delta_seconds;
 }
+
+void Time_System::set_fixed_delta_seconds(const f32 seconds) {
+    fixed_delta_seconds = seconds;
+}
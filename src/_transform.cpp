@@ -0,0 +1,129 @@
+#include "_transform.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+
+Transform_System::Transform_System() {
+    require_component<Transform>();
+}
+
+
+void Transform_System::update(Registry& reg) {
+    // Entities are only ever added, a different count means new ones that need a place in the order
+    const bool needs_sort = !is_order_valid || nodes.size() != get_entities().size();
+    if (needs_sort) {
+        sort_nodes(reg);
+    }
+
+    for (usize node_index = 0; node_index < nodes.size(); ++node_index) {
+        const Node& node = nodes[node_index];
+        Transform& transform = reg.get<Transform>(node.entity);
+
+        const bool has_parent = node.parent_index != no_parent_index;
+        const bool has_parent_changed = has_parent && has_world_changed[node.parent_index];
+
+        has_world_changed[node_index] = false;
+
+        // After sorting world_matrices has to be rebuilt, even for transforms that didn't change
+        if (!transform.is_dirty && !has_parent_changed && !needs_sort) {
+            continue;
+        }
+
+        if (transform.is_dirty) {
+            transform.update_local_matrix();
+            transform.is_dirty = false;
+        }
+
+        world_matrices[node_index] = has_parent
+                                   ? world_matrices[node.parent_index] * transform.local_matrix
+                                   : transform.local_matrix;
+
+        // Setters called with the current values and re-sorts don't count as changes for anything downstream
+        if (transform.world_matrix_version == 0 ||
+            std::memcmp(&transform.world_matrix, &world_matrices[node_index], sizeof(Mat4)) != 0) {
+            transform.world_matrix = world_matrices[node_index];
+            ++transform.world_matrix_version;
+            has_world_changed[node_index] = true;
+        }
+    }
+}
+
+
+void Transform_System::set_parent(Registry& reg, const Entity child, const Entity parent) {
+    Transform& transform = reg.get<Transform>(child);
+    if (transform.parent == parent) {
+        return;
+    }
+
+#if _DEBUG
+    for (Entity ancestor = parent; ancestor != Transform::no_parent; ancestor = reg.get<Transform>(ancestor).parent) {
+        assert(ancestor != child);
+    }
+#endif
+
+    transform.parent = parent;
+    transform.is_dirty = true;
+    is_order_valid = false;
+}
+
+
+void Transform_System::sort_nodes(Registry& reg) {
+    const std::vector<Entity>& entities = get_entities();
+
+
+    // Depth below the root, parents always have a smaller depth than their children
+    //
+    constexpr u32 unknown_depth = static_cast<u32>(-1);
+    std::vector<u32> depths(reg.num_entities(), unknown_depth);
+
+    auto find_depth = [&](const Entity entity) -> u32 {
+        // Walk up to the first ancestor with a known depth, then fill in the depths of the path
+        Entity ancestor = entity;
+        u32 num_steps = 0;
+        while (ancestor != Transform::no_parent && depths[ancestor] == unknown_depth) {
+            ancestor = reg.get<Transform>(ancestor).parent;
+            ++num_steps;
+        }
+
+        // Depth of the topmost ancestor that wasn't known yet, the entity is num_steps - 1 levels below it
+        const u32 top_depth = ancestor == Transform::no_parent ? 0 : depths[ancestor] + 1;
+
+        Entity path_entity = entity;
+        for (; num_steps > 0; --num_steps) {
+            depths[path_entity] = top_depth + num_steps - 1;
+            path_entity = reg.get<Transform>(path_entity).parent;
+        }
+        return depths[entity];
+    };
+
+    std::vector<std::pair<u32, Entity>> sorted_entities;
+    sorted_entities.reserve(entities.size());
+    for (const Entity entity : entities) {
+        sorted_entities.emplace_back(find_depth(entity), entity);
+    }
+    std::sort(sorted_entities.begin(), sorted_entities.end());
+
+
+    // Nodes, parents are looked up by the index they got in the sorted order
+    //
+    std::vector<u32> entity_node_indices(reg.num_entities(), no_parent_index);
+
+    nodes.clear();
+    nodes.reserve(sorted_entities.size());
+    for (const auto& [depth, entity] : sorted_entities) {
+        const Entity parent = reg.get<Transform>(entity).parent;
+        assert(parent == Transform::no_parent || entity_node_indices[parent] != no_parent_index);
+
+        entity_node_indices[entity] = static_cast<u32>(nodes.size());
+        nodes.emplace_back() = Node{
+            .entity = entity,
+            .parent_index = parent == Transform::no_parent ? no_parent_index : entity_node_indices[parent],
+        };
+    }
+
+    world_matrices.resize(nodes.size());
+    has_world_changed.assign(nodes.size(), false);
+    is_order_valid = true;
+}
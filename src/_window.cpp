@@ -1,16 +1,80 @@
 #include "_window.h"
 #include "_color.h"
+#include "_simd.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 
+#if ENABLE_SDL
+#include <SDL2/SDL.h>
+#endif
+
+
 // =====================================================================================================================
 // == Util =============================================================================================================
 // =====================================================================================================================
 
+#if ENABLE_SDL
 static void log_sdl_error() {
     std::cerr << "SDL error " << SDL_GetError() << std::endl;
 }
+#endif
+
+
+// Fills with streaming stores, which go past the caches instead of evicting what the rasterizer is about to read. Only
+// the unaligned ends of the span are written one element at a time.
+template <typename T>
+static void fill_streaming(T* const data, const usize count, const T value) {
+    using Lane_Scalar = std::conditional_t<std::is_same_v<T, f32>, f32, i32>;
+    constexpr usize register_size = simd::width * sizeof(T);
+
+    const auto lanes = simd::splat(static_cast<Lane_Scalar>(value));
+
+    usize index = 0;
+    for (; index < count && reinterpret_cast<uintptr_t>(data + index) % register_size != 0; ++index) {
+        data[index] = value;
+    }
+    for (; index + simd::width <= count; index += simd::width) {
+        simd::store_streaming(data + index, lanes);
+    }
+    for (; index < count; ++index) {
+        data[index] = value;
+    }
+}
+
+
+// Calls fill_row(y, start_x, end_x) for every pixel row of the blocks that is_dirty(block_index) selects. Neighbouring
+// dirty blocks are merged into a single span per row, so that the streaming stores fill whole cache lines.
+template <typename Is_Dirty, typename Fill_Row>
+static void for_each_dirty_block_row(const Window_System& window, Is_Dirty is_dirty, Fill_Row fill_row) {
+    constexpr i32 block_size = Window_System::depth_block_size;
+
+    for (i32 block_y = 0; block_y < window.num_depth_blocks_y; ++block_y) {
+        const usize row_blocks_start = static_cast<usize>(block_y) * window.num_depth_blocks_x;
+
+        for (i32 block_x = 0; block_x < window.num_depth_blocks_x; ) {
+            if (!is_dirty(row_blocks_start + block_x)) {
+                ++block_x;
+                continue;
+            }
+
+            const i32 run_start = block_x;
+            while (block_x < window.num_depth_blocks_x && is_dirty(row_blocks_start + block_x)) {
+                ++block_x;
+            }
+
+            const i32 start_x = run_start * block_size;
+            const i32 end_x = std::min(block_x * block_size, window.width);
+            const i32 end_y = std::min((block_y + 1) * block_size, window.height);
+
+            for (i32 y = block_y * block_size; y < end_y; ++y) {
+                fill_row(y, start_x, end_x);
+            }
+        }
+    }
+}
 
 
 // =====================================================================================================================
@@ -22,19 +86,63 @@ Window_System::Window_System(): width(0),
                   sdl_window(nullptr),
                   sdl_renderer(nullptr),
                   sdl_color_buffer_texture(nullptr),
-                  color_buffer({}) {
+                  color_buffer({}),
+                  color_buffer_pitch(0),
+                  depth_buffer({}),
+                  num_depth_blocks_x(0),
+                  num_depth_blocks_y(0),
+                  depth_block_min({}),
+                  depth_block_max({}),
+                  present_mode(Present_Mode::Copy),
+                  is_color_buffer_texture_locked(false),
+                  num_frame_buffers(1),
+                  frame_buffers({}),
+                  rendering_frame_buffer(0),
+                  present_queue({}),
+                  present_queue_size(0),
+                  copying_frame_buffer(no_frame_buffer),
+                  staging_pixels(nullptr),
+                  staging_pitch(0),
+                  is_frame_staged(false),
+                  present_stats({}),
+                  is_shutting_down(false) {
 }
 
 
 Window_System::~Window_System() {
+    if (copy_thread.joinable()) {
+        {
+            std::lock_guard lock{present_mutex};
+            is_shutting_down = true;
+        }
+        frame_queued.notify_all();
+        copy_thread.join();
+    }
+
+#if ENABLE_SDL
+    if (present_mode == Present_Mode::Headless) {
+        return;
+    }
+
+    if (is_color_buffer_texture_locked) SDL_UnlockTexture(sdl_color_buffer_texture);
     if (sdl_color_buffer_texture) SDL_DestroyTexture(sdl_color_buffer_texture);
     if (sdl_renderer) SDL_DestroyRenderer(sdl_renderer);
     if (sdl_window) SDL_DestroyWindow(sdl_window);
     SDL_Quit();
+#endif
 }
 
 
-bool Window_System::init(const i32 resolution_width, const i32 resolution_height, const bool real_fullscreen) {
+// Without SDL none of the parameters are used, not even by the asserts in release builds
+bool Window_System::init([[maybe_unused]] const i32 resolution_width,
+                         [[maybe_unused]] const i32 resolution_height,
+                         [[maybe_unused]] const bool real_fullscreen,
+                         [[maybe_unused]] const Present_Mode requested_present_mode,
+                         [[maybe_unused]] const usize num_async_frame_buffers) {
+    assert(requested_present_mode != Present_Mode::Headless);
+    assert(num_async_frame_buffers >= min_frame_buffers && num_async_frame_buffers <= max_frame_buffers);
+
+#if ENABLE_SDL
     if (SDL_Init(SDL_INIT_VIDEO) != 0) {
         std::cerr << __FUNCTION__ << ": SDL_init failed" << std::endl;
         return {};
@@ -123,14 +231,79 @@ bool Window_System::init(const i32 resolution_width, const i32 resolution_height
                                                             );
     }
 
-    window.color_buffer = std::vector(window.width * window.height, Color::black());
-    window.color_buffer.shrink_to_fit();
+    // Present mode, zero copy falls back to copying when the texture can't be viewed as a color buffer
+    window.present_mode = requested_present_mode;
+
+    if (window.present_mode == Present_Mode::Zero_Copy && !window.lock_color_buffer_texture()) {
+        window.present_mode = Present_Mode::Copy;
+    }
+
+    if (window.present_mode == Present_Mode::Async) {
+        window.num_frame_buffers = num_async_frame_buffers;
+        if (!window.lock_staging_texture()) {
+            return false;
+        }
+    }
+
+    window.init_buffers();
+
+    return true;
+#else
+    ERR("built without SDL, only headless rendering is available");
+    return false;
+#endif
+}
+
+
+bool Window_System::init_headless(const i32 resolution_width, const i32 resolution_height) {
+    assert(resolution_width > 0 && resolution_height > 0);
+
+    width = resolution_width;
+    height = resolution_height;
+    present_mode = Present_Mode::Headless;
+
+    init_buffers();
 
     return true;
 }
 
 
+void Window_System::init_buffers() {
+    depth_buffer = Aligned_Vector<f32>(width * height, 1.f);
+
+    num_depth_blocks_x = (width + depth_block_size - 1) / depth_block_size;
+    num_depth_blocks_y = (height + depth_block_size - 1) / depth_block_size;
+    depth_block_min = std::vector(num_depth_blocks_x * num_depth_blocks_y, 1.f);
+    depth_block_max = std::vector(num_depth_blocks_x * num_depth_blocks_y, 1.f);
+
+    for (std::vector<u8>& dirty_blocks : dirty_color_blocks) {
+        dirty_blocks = std::vector<u8>(num_depth_blocks_x * num_depth_blocks_y, 0);
+    }
+
+    // Zero copy already points the color buffer at the locked texture
+    if (present_mode != Present_Mode::Zero_Copy) {
+        for (usize buffer_index = 0; buffer_index < num_frame_buffers; ++buffer_index) {
+            frame_buffers[buffer_index] = Aligned_Vector<Color>(width * height, Color::black());
+        }
+
+        rendering_frame_buffer = 0;
+        color_buffer = frame_buffers[0];
+        color_buffer_pitch = width;
+    }
+    clear_color_buffer(Color::black());
+
+    if (present_mode == Present_Mode::Async) {
+        copy_thread = std::thread(&Window_System::copy_loop, this);
+    }
+}
+
+
 bool Window_System::poll_events() const {
+#if ENABLE_SDL
+    if (present_mode == Present_Mode::Headless) {
+        return true;
+    }
+
     SDL_Event event;
     while (SDL_PollEvent(&event)) {
         switch (event.type) {
@@ -146,6 +319,7 @@ bool Window_System::poll_events() const {
             default: ;
         }
     }
+#endif
 
     return true;
 }
@@ -156,33 +330,231 @@ void Window_System::set_pixel(const i32 x, const i32 y, const Color color) {
         return;
     }
 
-    const i32 index = (width * y) + x;
-    if (index < 0 || index >= color_buffer.size()) {
+    color_buffer[(color_buffer_pitch * y) + x] = color;
+    mark_color_block_dirty(x / depth_block_size, y / depth_block_size);
+}
+
+
+void Window_System::set_background_pixel(const i32 x, const i32 y, const Color color) {
+    if (x < 0 || x >= width || y < 0 || y >= height) {
         return;
     }
 
-    color_buffer[index] = color;
+    color_buffer[(color_buffer_pitch * y) + x] = color;
+}
+
+
+void Window_System::mark_color_block_dirty(const i32 block_x, const i32 block_y) {
+    dirty_color_blocks[rendering_frame_buffer][(block_y * num_depth_blocks_x) + block_x] = 1;
 }
 
 
 bool Window_System::present() {
-    if (!render_present_color_buffer()) {
-        return false;
+    if (present_mode == Present_Mode::Async) {
+        // Shows the frame the copy thread finished since the last call, if any. Presenting stays on this thread.
+        if (!present_staged_frame() || !queue_frame_for_present()) {
+            return false;
+        }
     }
-    clear_color_buffer(Color::black());
+    else if (present_mode == Present_Mode::Headless) {
+        // Nothing to show the frame on, it could only be read from the color buffer before this call
+        ++present_stats.num_presented;
+    }
+    else {
+        if (!render_present_color_buffer()) {
+            return false;
+        }
+        ++present_stats.num_presented;
+    }
+
+    // Locked texture pixels aren't guaranteed to keep their contents, so they always get cleared in full
+    if (present_mode == Present_Mode::Zero_Copy) {
+        clear_color_buffer(Color::black());
+    } else {
+        clear_dirty_color_blocks(Color::black());
+    }
+    clear_depth_buffer();
 
     return true;
 }
 
 
 void Window_System::clear_color_buffer(const Color in_color) {
-    std::fill(color_buffer.begin(), color_buffer.end(), in_color);
+    for (i32 y = 0; y < height; ++y) {
+        fill_streaming(&color_buffer[static_cast<usize>(y) * color_buffer_pitch].hex, width, in_color.hex);
+    }
+    simd::streaming_fence();
+
+    std::vector<u8>& dirty_blocks = dirty_color_blocks[rendering_frame_buffer];
+    std::fill(dirty_blocks.begin(), dirty_blocks.end(), 0);
+}
+
+
+void Window_System::clear_dirty_color_blocks(const Color in_color) {
+    std::vector<u8>& dirty_blocks = dirty_color_blocks[rendering_frame_buffer];
+
+    for_each_dirty_block_row(*this,
+                             [&](const usize block_index) -> bool { return dirty_blocks[block_index] != 0; },
+                             [&](const i32 y, const i32 start_x, const i32 end_x) -> void {
+                                 const usize row_start = static_cast<usize>(y) * color_buffer_pitch;
+                                 fill_streaming(&color_buffer[row_start + start_x].hex, end_x - start_x, in_color.hex);
+                             });
+    simd::streaming_fence();
+
+    std::fill(dirty_blocks.begin(), dirty_blocks.end(), 0);
+}
+
+
+void Window_System::clear_depth_buffer() {
+    // Every written block has a depth below the far plane somewhere, the others are still cleared
+    for_each_dirty_block_row(*this,
+                             [&](const usize block_index) -> bool { return depth_block_min[block_index] < 1.f; },
+                             [&](const i32 y, const i32 start_x, const i32 end_x) -> void {
+                                 const usize row_start = static_cast<usize>(y) * width;
+                                 fill_streaming(&depth_buffer[row_start + start_x], end_x - start_x, 1.f);
+                             });
+    simd::streaming_fence();
+
+    std::fill(depth_block_min.begin(), depth_block_min.end(), 1.f);
+    std::fill(depth_block_max.begin(), depth_block_max.end(), 1.f);
+}
+
+
+void Window_System::update_depth_block(const i32 block_x, const i32 block_y) {
+    const i32 start_x = block_x * depth_block_size;
+    const i32 start_y = block_y * depth_block_size;
+    const i32 end_x = std::min(start_x + depth_block_size, width);
+    const i32 end_y = std::min(start_y + depth_block_size, height);
+
+    f32 min_depth = 1.f;
+    f32 max_depth = 0.f;
+
+    if (end_x - start_x == depth_block_size && depth_block_size % simd::width == 0) {
+        simd::F32_Lanes min_lanes = simd::splat(min_depth);
+        simd::F32_Lanes max_lanes = simd::splat(max_depth);
+
+        for (i32 y = start_y; y < end_y; ++y) {
+            for (i32 x = start_x; x < end_x; x += static_cast<i32>(simd::width)) {
+                const simd::F32_Lanes depths = simd::load(&depth_buffer[(y * width) + x]);
+                min_lanes = simd::min(min_lanes, depths);
+                max_lanes = simd::max(max_lanes, depths);
+            }
+        }
+
+        min_depth = simd::reduce_min(min_lanes);
+        max_depth = simd::reduce_max(max_lanes);
+    }
+    else {
+        // Block on the right edge of the buffer, only partially inside
+        for (i32 y = start_y; y < end_y; ++y) {
+            for (i32 x = start_x; x < end_x; ++x) {
+                min_depth = std::min(min_depth, depth_buffer[(y * width) + x]);
+                max_depth = std::max(max_depth, depth_buffer[(y * width) + x]);
+            }
+        }
+    }
+
+    const usize block_index = (block_y * num_depth_blocks_x) + block_x;
+    depth_block_min[block_index] = min_depth;
+    depth_block_max[block_index] = max_depth;
+}
+
+
+#if ENABLE_SDL
+bool Window_System::lock_color_buffer_texture() {
+    void* pixels;
+    i32 pitch;
+    if (SDL_LockTexture(sdl_color_buffer_texture,
+                        nullptr,  // full rect
+                        &pixels,
+                        &pitch
+                        ) != 0) {
+        log_sdl_error();
+        return false;
+    }
+    is_color_buffer_texture_locked = true;
+
+    // Rows that don't start on a whole pixel can't be viewed as Colors, those keep going through a copy
+    if (pitch % sizeof(Color) != 0) {
+        SDL_UnlockTexture(sdl_color_buffer_texture);
+        is_color_buffer_texture_locked = false;
+        return false;
+    }
+
+    // The locked pixels keep whatever the renderer last left in them, they get cleared before anything is drawn
+    color_buffer_pitch = pitch / static_cast<i32>(sizeof(Color));
+    color_buffer = std::span<Color>{static_cast<Color*>(pixels), static_cast<usize>(color_buffer_pitch) * height};
+    return true;
+}
+
+
+bool Window_System::lock_staging_texture() {
+    void* pixels;
+    if (SDL_LockTexture(sdl_color_buffer_texture,
+                        nullptr,  // full rect
+                        &pixels,
+                        &staging_pitch
+                        ) != 0) {
+        log_sdl_error();
+        return false;
+    }
+    is_color_buffer_texture_locked = true;
+    staging_pixels = static_cast<u8*>(pixels);
+    return true;
+}
+
+
+bool Window_System::render_present_color_buffer() {
+    if (present_mode == Present_Mode::Copy) {
+        return copy_to_texture_and_present(color_buffer, color_buffer_pitch);
+    }
+
+    // Zero copy, the frame is already in the texture and only has to be unlocked
+    SDL_UnlockTexture(sdl_color_buffer_texture);
+    is_color_buffer_texture_locked = false;
+
+    if (!render_present_texture()) {
+        return false;
+    }
+
+    // Lock again for the next frame. The pixels may move between locks, so the view is renewed every time.
+    return lock_color_buffer_texture();
+}
+
+
+bool Window_System::present_staged_frame() {
+    {
+        std::lock_guard lock{present_mutex};
+        if (!is_frame_staged) {
+            return true;
+        }
+    }
+
+    // The copy thread leaves the texture alone until the next lock is handed to it
+    SDL_UnlockTexture(sdl_color_buffer_texture);
+    is_color_buffer_texture_locked = false;
+
+    if (!render_present_texture()) {
+        return false;
+    }
+
+    // Hand the freshly locked pixels to the copy thread for the next frame
+    {
+        std::lock_guard lock{present_mutex};
+        if (!lock_staging_texture()) {
+            return false;
+        }
+        is_frame_staged = false;
+        ++present_stats.num_presented;
+    }
+    frame_queued.notify_one();
+
+    return true;
 }
 
 
-bool Window_System::render_present_color_buffer() const {
+bool Window_System::copy_to_texture_and_present(const std::span<const Color> pixels, const i32 pixels_pitch) const {
     static_assert(sizeof(Color) == 4);
-    assert(color_buffer.size() == width * height);
 
     auto failure = []() -> bool {
         log_sdl_error();
@@ -190,31 +562,154 @@ bool Window_System::render_present_color_buffer() const {
     };
 
 
-    void* pixels;
-    i32 pitch;
-    i32 result = SDL_LockTexture(sdl_color_buffer_texture, 
-                                 nullptr,  // full rect
-                                 &pixels, 
-                                 &pitch
-                                 );
-    if (result != 0) {
+    void* texture_pixels;
+    i32 texture_pitch;
+    if (SDL_LockTexture(sdl_color_buffer_texture,
+                        nullptr,  // full rect
+                        &texture_pixels,
+                        &texture_pitch
+                        ) != 0) {
         return failure();
     }
-    assert(pitch == width * sizeof(Color));
 
-    memcpy(pixels, color_buffer.data(), sizeof(Color) * color_buffer.size());
+    // Row by row, the pitch of the texture may differ from the width
+    for (i32 y = 0; y < height; ++y) {
+        memcpy(static_cast<u8*>(texture_pixels) + (static_cast<usize>(y) * texture_pitch),
+               &pixels[static_cast<usize>(y) * pixels_pitch],
+               sizeof(Color) * width
+               );
+    }
     SDL_UnlockTexture(sdl_color_buffer_texture);
 
-    result = SDL_RenderCopy(sdl_renderer, 
-                            sdl_color_buffer_texture, 
-                            nullptr, 
-                            nullptr
-                            );
-    if (result != 0) {
-        return failure();
+    return render_present_texture();
+}
+
+
+bool Window_System::render_present_texture() const {
+    if (SDL_RenderCopy(sdl_renderer,
+                       sdl_color_buffer_texture,
+                       nullptr,
+                       nullptr
+                       ) != 0) {
+        log_sdl_error();
+        return false;
     }
 
     SDL_RenderPresent(sdl_renderer);
 
     return true;
 }
+#else
+
+// Without SDL every window is headless, none of these can be reached
+bool Window_System::lock_color_buffer_texture() { return false; }
+bool Window_System::lock_staging_texture() { return false; }
+bool Window_System::render_present_color_buffer() { return false; }
+bool Window_System::copy_to_texture_and_present(std::span<const Color>, i32) const { return false; }
+bool Window_System::render_present_texture() const { return false; }
+bool Window_System::present_staged_frame() { return false; }
+
+#endif
+
+
+// =====================================================================================================================
+// == Async present ====================================================================================================
+// =====================================================================================================================
+
+bool Window_System::queue_frame_for_present() {
+    std::unique_lock lock{present_mutex};
+    present_queue[present_queue_size] = rendering_frame_buffer;
+    ++present_queue_size;
+    rendering_frame_buffer = no_frame_buffer;
+    frame_queued.notify_one();
+
+
+    // Next frame buffer to render into. The oldest frame still in the queue never made it to the screen and is
+    // rendered over when there is no other one. Fewer frame buffers make rendering wait for the copy thread instead.
+    usize frame_buffer = find_free_frame_buffer();
+
+    if (frame_buffer == no_frame_buffer && present_queue_size > 1) {
+        frame_buffer = present_queue[0];
+        std::copy(present_queue.begin() + 1, present_queue.begin() + present_queue_size, present_queue.begin());
+        --present_queue_size;
+        ++present_stats.num_dropped;
+    }
+
+    if (frame_buffer == no_frame_buffer) {
+        ++present_stats.num_late;
+        frame_buffer_freed.wait(lock, [this, &frame_buffer]() -> bool {
+            frame_buffer = find_free_frame_buffer();
+            return frame_buffer != no_frame_buffer;
+        });
+    }
+
+    rendering_frame_buffer = frame_buffer;
+    color_buffer = frame_buffers[frame_buffer];
+    return true;
+}
+
+
+usize Window_System::find_free_frame_buffer() const {
+    for (usize buffer_index = 0; buffer_index < num_frame_buffers; ++buffer_index) {
+        const bool is_queued = std::find(present_queue.begin(),
+                                         present_queue.begin() + present_queue_size,
+                                         buffer_index
+                                         ) != present_queue.begin() + present_queue_size;
+
+        if (buffer_index != rendering_frame_buffer && buffer_index != copying_frame_buffer && !is_queued) {
+            return buffer_index;
+        }
+    }
+    return no_frame_buffer;
+}
+
+
+void Window_System::copy_loop() {
+    static_assert(sizeof(Color) == 4);
+
+    while (true) {
+        usize frame_buffer;
+        u8* pixels;
+        i32 pitch;
+        {
+            // The staged frame has to be shown before the texture can take the next one
+            std::unique_lock lock{present_mutex};
+            frame_queued.wait(lock, [this]() -> bool {
+                return is_shutting_down || (present_queue_size > 0 && !is_frame_staged);
+            });
+            if (is_shutting_down) {
+                return;
+            }
+
+            frame_buffer = present_queue[0];
+            copying_frame_buffer = frame_buffer;
+            std::copy(present_queue.begin() + 1, present_queue.begin() + present_queue_size, present_queue.begin());
+            --present_queue_size;
+
+            pixels = staging_pixels;
+            pitch = staging_pitch;
+        }
+
+        // Rendering stays away from the frame buffer and the main thread from the texture until the copy is staged.
+        // Row by row, the pitch of the texture may differ from the width.
+        for (i32 y = 0; y < height; ++y) {
+            memcpy(pixels + (static_cast<usize>(y) * pitch),
+                   &frame_buffers[frame_buffer][static_cast<usize>(y) * width],
+                   sizeof(Color) * width
+                   );
+        }
+
+        {
+            std::lock_guard lock{present_mutex};
+            copying_frame_buffer = no_frame_buffer;
+            is_frame_staged = true;
+        }
+        frame_buffer_freed.notify_one();
+    }
+}
+
+
+Window_System::Present_Stats Window_System::get_present_stats() const {
+    std::lock_guard lock{present_mutex};
+    return present_stats;
+}
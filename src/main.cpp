@@ -1,20 +1,23 @@
 #include "_asset_store.h"
+#include "_bvh.h"
 #include "_camera.h"
 #include "_debug_rotate.h"
 #include "_debug_texture.h"
 #include "_ecs.h"
+#include "_frame_arena.h"
 #include "_mesh_render.h"
 #include "_renderer.h"
+#include "_tile_raster.h"
 #include "_time.h"
+#include "_transform.h"
 #include "_window.h"
 
+#include <charconv>
+
 
 static void spawn_icosphere(Registry& reg) {
     const Entity sphere = reg.add();
-    reg.add(sphere, Transform{
-        .translation = {-2.f, -2.f, 5.f},
-        .scale = {1.2f, 2.f, 1.2f},
-    });
+    reg.add(sphere, Transform{Vec3{-2.f, -2.f, 5.f}, Vec3::zeroed(), Vec3{1.2f, 2.f, 1.2f}});
     reg.add(sphere, Debug_Rotate{});
     reg.add(sphere, reg.get<Asset_Store_System>().get_mesh_id("isphere"));
 }
@@ -22,9 +25,7 @@ static void spawn_icosphere(Registry& reg) {
 
 static void spawn_cube(Registry& reg, const Vec3 translation) {
     const Entity cube = reg.add();
-    reg.add(cube, Transform{
-        .translation = translation,
-    });
+    reg.add(cube, Transform{translation});
     reg.add(cube, Debug_Rotate{});
     reg.add(cube, reg.get<Asset_Store_System>().get_mesh_id("cube"));
 }
@@ -41,19 +42,86 @@ static void test_texture(Registry& reg, const std::string_view filename) {
 }
 
 
-i32 main() {
+// Whole positive number, anything else including trailing characters is rejected
+static bool parse_count(const std::string_view text, u64& count) {
+    const auto [end, error] = std::from_chars(text.data(), text.data() + text.size(), count);
+    return error == std::errc{} && end == text.data() + text.size() && count > 0;
+}
+
+
+i32 main(const i32 argc, char** argv) {
+    // --headless renders without SDL or a display, --frames <count> stops after that many frames. --present picks how
+    // frames reach the window, --frame-buffers how many of them async present rotates through.
+    constexpr u64 num_default_headless_frames = 100;   // nothing would ever stop a headless run otherwise
+
+    bool is_headless = false;
+    u64 num_frames = 0;   // until the window gets closed
+    Window_System::Present_Mode present_mode = Window_System::Present_Mode::Zero_Copy;
+    usize num_frame_buffers = Window_System::max_frame_buffers;
+
+    for (i32 arg_index = 1; arg_index < argc; ++arg_index) {
+        const std::string_view arg = argv[arg_index];
+
+        if (arg == "--headless") {
+            is_headless = true;
+        } else if (arg == "--frames" && arg_index + 1 < argc) {
+            if (!parse_count(argv[++arg_index], num_frames)) {
+                ERR("--frames expects a positive number, got " << argv[arg_index]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--present" && arg_index + 1 < argc) {
+            const std::string_view mode = argv[++arg_index];
+            if (mode == "zero-copy") {
+                present_mode = Window_System::Present_Mode::Zero_Copy;
+            } else if (mode == "copy") {
+                present_mode = Window_System::Present_Mode::Copy;
+            } else if (mode == "async") {
+                present_mode = Window_System::Present_Mode::Async;
+            } else {
+                ERR("unknown present mode " << mode << ", expected zero-copy, copy or async");
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--frame-buffers" && arg_index + 1 < argc) {
+            u64 count = 0;
+            if (!parse_count(argv[++arg_index], count)
+                || count < Window_System::min_frame_buffers
+                || count > Window_System::max_frame_buffers) {
+                ERR("--frame-buffers has to be " << Window_System::min_frame_buffers << " or "
+                    << Window_System::max_frame_buffers);
+                return EXIT_FAILURE;
+            }
+            num_frame_buffers = count;
+        } else {
+            ERR("unknown argument " << arg << ", expected --headless, --frames <count>, "
+                "--present zero-copy|copy|async or --frame-buffers <count>");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (is_headless && num_frames == 0) {
+        num_frames = num_default_headless_frames;
+    }
+
     const std::unique_ptr<Registry> reg = std::make_unique<Registry>();
 
     reg->add<Window_System>();
     Window_System& window = reg->get<Window_System>();
-    if (!window.init(800, 600, false)) {
-        return false;
+
+    const bool is_window_ready = is_headless
+                                 ? window.init_headless(800, 600)
+                                 : window.init(800, 600, false, present_mode, num_frame_buffers);
+    if (!is_window_ready) {
+        return EXIT_FAILURE;
     }
 
     reg->add<Time_System>();
+    reg->add<Frame_Arena_System>();
     reg->add<Render_System>(*reg);
+    reg->add<Tile_Raster_System>(*reg);
     reg->add<Camera_System>(*reg);
     reg->add<Asset_Store_System>();
+    reg->add<Transform_System>();
+    reg->add<Bvh_System>(*reg);
 
     reg->add<Mesh_Render_System>(*reg);
     reg->add<Debug_Rotate_System>();
@@ -73,12 +141,17 @@ i32 main() {
     // test_texture(*reg, "tiger.tga");
 
 
-    while (true) {
-        if (!window.poll_events()) return EXIT_SUCCESS;
+    for (u64 frame_index = 0; num_frames == 0 || frame_index < num_frames; ++frame_index) {
+        if (!window.poll_events()) {
+            break;
+        }
 
         reg->refresh_systems_entity_sets();
+        reg->get<Frame_Arena_System>().update();
         reg->get<Time_System>().update();
         reg->get<Debug_Rotate_System>().update(*reg);
+        reg->get<Transform_System>().update(*reg);
+        reg->get<Bvh_System>().update(*reg);
         reg->get<Mesh_Render_System>().update(*reg);
 
         if (reg->has<Debug_Display_Texture_System>()) {
@@ -87,4 +160,10 @@ i32 main() {
 
         if (!window.present()) return EXIT_FAILURE;
     }
+
+    const Window_System::Present_Stats present_stats = window.get_present_stats();
+    INFO("presented " << present_stats.num_presented << " frames, dropped " << present_stats.num_dropped
+         << ", late " << present_stats.num_late);
+
+    return EXIT_SUCCESS;
 }
@@ -2,6 +2,7 @@
 #include "_common.h"
 #include "_ecs.h"
 #include "_math.h"
+#include "_memory.h"
 #include "_types.h"
 
 
@@ -19,12 +20,38 @@ struct Asset_Store_System final : System {
 
 private:
     // Mesh
+    struct Mesh_Lod_Range {
+        usize vertices_start;
+        usize num_vertices;
+        usize streams_start;
+        usize faces_start;   // also indexes faces_uv_indices and face_normals
+        usize num_faces;
+        usize meshlets_start;
+        usize num_meshlets;
+        f32 error;
+    };
+
+    struct Mesh_Range {
+        std::array<Mesh_Lod_Range, max_mesh_lods> lods;
+        usize num_lods;
+        Bounds bounds;
+    };
+
+    Mesh_Lod_Range add_mesh_lod(usize vertices_start, usize faces_start, f32 error);
+
     std::vector<std::string> mesh_names;
-    std::vector<Mesh_View> mesh_views;
+    std::vector<Mesh_Range> mesh_ranges;   // views are built on access, the storage below may reallocate on load
     std::vector<Vec3> vertices;
     std::vector<Vec2> uv_coordinates;
     std::vector<Face_Vertex_Indices> faces;
     std::vector<Face_UV_Indices> faces_uv_indices;
+    std::vector<Vec3> face_normals;
+    std::vector<Meshlet> meshlets;
+
+    // Vertex positions as separate x/y/z streams, every level of detail starts at a multiple of simd::width
+    Aligned_Vector<f32> vertex_streams_x;
+    Aligned_Vector<f32> vertex_streams_y;
+    Aligned_Vector<f32> vertex_streams_z;
 
     bool load_obj_mesh(std::string_view filename);
 
@@ -0,0 +1,94 @@
+#pragma once
+#include "_common.h"
+#include "_math.h"
+
+#include <span>
+
+
+// Axis aligned
+struct Bounding_Box {
+    Vec3 min;
+    Vec3 max;
+
+    static Bounding_Box from_points(std::span<const Vec3> points);
+    static Bounding_Box merged(const Bounding_Box& a, const Bounding_Box& b);
+
+    Vec3 center() const;
+    Vec3 half_extents() const;
+    f32 surface_area() const;
+
+    bool contains(const Bounding_Box& other) const;
+    bool contains(Vec3 point) const;
+
+    // Grown by margin on every side
+    Bounding_Box expanded(f32 margin) const;
+
+    // Smallest axis aligned box around the transformed box
+    Bounding_Box transformed(const Mat4& mat) const;
+};
+
+
+// Structure of arrays alternative to Bounding_Sphere for kernels that are vectorized across many spheres
+struct Bounding_Sphere_Streams {
+    std::span<f32> center_x;
+    std::span<f32> center_y;
+    std::span<f32> center_z;
+    std::span<f32> radius;
+};
+
+
+struct Bounding_Sphere {
+    Vec3 center;
+    f32 radius;
+
+    // Centered on the bounding box of the points, not the minimal sphere but cheap and close for typical meshes
+    static Bounding_Sphere from_points(std::span<const Vec3> points);
+
+    // Radius is scaled by the largest axis scale of mat, so the result stays conservative under non-uniform scale
+    Bounding_Sphere transformed(const Mat4& mat) const;
+
+    // transformed() by every matrix at once, vectorized across the matrices. Used for the instances of a mesh.
+    void transformed(std::span<const Mat4> matrices, Bounding_Sphere_Streams spheres) const;
+};
+
+
+struct Bounds {
+    Bounding_Box box;
+    Bounding_Sphere sphere;
+
+    static Bounds from_points(std::span<const Vec3> points);
+};
+
+
+// Points with dot(normal, point) + distance >= 0 are on the inner side
+struct Plane {
+    Vec3 normal;
+    f32 distance;
+
+    f32 signed_distance(Vec3 point) const;
+};
+
+
+struct Frustum {
+    enum Side : u8 {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        Count,
+    };
+
+    std::array<Plane, Count> planes;
+
+    // Planes of the view volume -w <= x <= w, -w <= y <= w, 0 <= z <= w, in the space that view_projection maps from
+    static Frustum from_view_projection(const Mat4& view_projection);
+
+    // Conservative, may report false for volumes that are just outside of a corner
+    bool is_outside(const Bounding_Sphere& sphere) const;
+    bool is_outside(const Bounding_Box& box) const;
+
+    // is_outside() for every sphere at once, is_outside_flags receives 1 for spheres outside and 0 otherwise
+    void are_outside(Bounding_Sphere_Streams spheres, std::span<u32> is_outside_flags) const;
+};
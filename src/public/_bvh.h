@@ -0,0 +1,89 @@
+#pragma once
+#include "_common.h"
+#include "_bounds.h"
+#include "_ecs.h"
+#include "_types.h"
+
+
+// Dynamic bounding volume hierarchy over axis aligned boxes. Leaves store fat boxes, grown by a margin, so small
+// movements don't change the tree. Inserts pick the sibling with the least surface area cost and the tree is kept
+// balanced with AVL style rotations.
+struct Bvh {
+    static constexpr i32 null_node = -1;
+
+    // Returns the leaf id, stable until the leaf is removed
+    i32 insert(const Bounding_Box& box, usize user_data);
+    void remove(i32 leaf);
+
+    // Reinserts the leaf if box left its fat box, returns whether it did
+    bool move(i32 leaf, const Bounding_Box& box);
+
+    usize get_user_data(i32 leaf) const;
+    const Bounding_Box& get_fat_box(i32 leaf) const;
+    i32 get_height() const;
+
+    // Queries append the user data of every leaf whose fat box passes the test
+    void query(const Frustum& frustum, std::vector<usize>& results) const;
+    void query(Vec3 point, std::vector<usize>& results) const;
+    void query_ray(Vec3 origin, Vec3 direction, f32 max_distance, std::vector<usize>& results) const;
+
+private:
+    struct Node {
+        Bounding_Box box;
+        usize user_data;
+        i32 parent;              // next free node while on the free list
+        i32 children[2];
+        i32 height;              // leaves are 0, free nodes -1
+
+        bool is_leaf() const { return children[0] == null_node; }
+    };
+
+    std::vector<Node> nodes;
+    i32 root = null_node;
+    i32 free_list = null_node;
+
+    struct Frustum_Stack_Entry {
+        i32 node;
+        u32 plane_mask;   // planes the node may still cross
+    };
+
+    // Traversal scratch, queries are not thread safe
+    mutable std::vector<i32> node_stack;
+    mutable std::vector<Frustum_Stack_Entry> frustum_stack;
+
+    i32 allocate_node();
+    void free_node(i32 node);
+
+    void insert_leaf(i32 leaf);
+    void remove_leaf(i32 leaf);
+
+    void refit_ancestors(i32 node);
+    i32 balance(i32 node);
+};
+
+
+// Keeps a Bvh over the world space bounds of every entity with a Transform and a Mesh_Id. Only entities whose world
+// matrix changed since the last update are refit, so Transform_System has to update first.
+struct Bvh_System final : System {
+    explicit Bvh_System(Registry& reg);
+
+    void update(Registry& reg);
+
+    // Entities whose bounds may be inside the frustum, conservative
+    void query_visible(const Frustum& frustum, std::vector<Entity>& entities) const;
+
+    // Picking, entities whose bounds contain the point or are hit by the ray
+    void query_point(Vec3 point, std::vector<Entity>& entities) const;
+    void query_ray(Vec3 origin, Vec3 direction, f32 max_distance, std::vector<Entity>& entities) const;
+
+private:
+    const Asset_Store_System& asset_store;
+
+    struct Entity_Leaf {
+        i32 leaf = Bvh::null_node;
+        u32 world_matrix_version = 0;
+    };
+
+    Bvh tree;
+    std::vector<Entity_Leaf> entity_leaves;   // indexed by entity
+};
@@ -1,5 +1,6 @@
 #pragma once
 #include "_common.h"
+#include "_bounds.h"
 #include "_ecs.h"
 #include "_math.h"
 
@@ -11,13 +12,22 @@ struct Camera_System final : System {
     explicit Camera_System(Registry& registry);
 
     void set_fov(f32 fov_deg);
+    void set_position(Vec3 new_position);
+    // Yaw around the y-axis, then pitch around the local x-axis. Both zero looks down positive z.
+    void set_rotation(f32 yaw_rad, f32 pitch_rad);
+
     Mat4 get_projection_matrix() const;
+    Mat4 get_view_matrix() const;
+    Mat4 get_view_projection_matrix() const;
+    Frustum get_frustum() const;   // world space
     Vec3 get_position() const;
 
 private:
     Window_System& window;
 
     Vec3 position;
+    f32 yaw;
+    f32 pitch;
     f32 fov;
     f32 aspect_ratio;
     f32 z_near;
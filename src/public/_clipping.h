@@ -0,0 +1,37 @@
+#pragma once
+#include "_common.h"
+#include "_math.h"
+
+
+// Polygon clipping in homogeneous clip space, before the perspective divide. Points inside the view volume satisfy
+// -w <= x <= w, -w <= y <= w and 0 <= z <= w.
+namespace clipping {
+
+
+// Every clip plane can add at most one vertex to a convex polygon
+constexpr usize max_polygon_vertices = 3 + 6;
+
+
+struct Polygon {
+    std::array<Vec4, max_polygon_vertices> vertices;
+    usize num_vertices = 0;
+
+    static Polygon from_triangle(const std::array<Vec4, 3>& corners);
+};
+
+
+// Whether the triangle needs to go through clip_polygon. guard_band is the x and y extent that the rasterizer accepts,
+// in normalized device coordinates. Triangles are only clipped against the sides once they reach outside of it.
+enum class Triangle_Clip_Result : u8 {
+    Inside,          // Within near, far and the guard band
+    Outside,         // All corners outside of the same plane
+    Needs_Clipping,
+};
+Triangle_Clip_Result classify_triangle(const std::array<Vec4, 3>& corners, Vec2 guard_band);
+
+
+// Clips the polygon against the near and far planes, and against the guard band sides
+void clip_polygon(Polygon& polygon, Vec2 guard_band);
+
+
+} // namespace clipping
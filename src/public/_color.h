@@ -1,6 +1,9 @@
 #pragma once
 #include "_common.h"
 
+#include <cassert>
+#include <span>
+
 
 struct Color {
     union {
@@ -28,4 +31,7 @@ struct Color {
     consteval static Color yellow() { return Color{.hex = 0xFFFFFF00}; }
 
     Color with_intensity(f32 percentage) const;
+
+    // Batched with_intensity, scales every color by the intensity at the same index. Percentages must be in [0, 1].
+    static void apply_intensities(std::span<Color> colors, std::span<const f32> intensities);
 };
@@ -0,0 +1,31 @@
+#pragma once
+#include "_common.h"
+#include "_ecs.h"
+#include "_memory.h"
+
+
+// Owns the arena for data that systems only need during the current frame. update() has to run once at the start of
+// every frame, before any system allocates from the arena.
+struct Frame_Arena_System final : System {
+    explicit Frame_Arena_System();
+    void update();
+
+    Frame_Arena& get_arena();
+
+#if ENABLE_ALLOCATION_COUNTING
+    // Heap allocations made between the last two updates
+    u64 get_heap_allocations_last_frame() const;
+#endif
+
+private:
+    Frame_Arena arena;
+
+#if ENABLE_ALLOCATION_COUNTING
+    // Containers are still growing to their steady state sizes during the first frames
+    static constexpr u64 num_warm_up_frames = 60;
+
+    u64 frame_index = 0;
+    u64 num_heap_allocations_at_frame_start = 0;
+    u64 heap_allocations_last_frame = 0;
+#endif
+};
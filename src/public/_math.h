@@ -1,6 +1,8 @@
 #pragma once
 #include "_common.h"
 
+#include <span>
+
 
 struct Vec2i {
     union {
@@ -201,6 +203,18 @@ struct Mat4 {
     static Mat4 rot_y(float angle);
     static Mat4 rot_z(float angle);
 
+    // Cofactor matrix of the upper 3x3, transforms normals (cross products) of points transformed by mat without
+    // renormalizing or inverting. Translation is dropped.
+    static Mat4 normal_matrix(const Mat4& mat);
+
+    // Inverse of a matrix with an invertible upper 3x3 and a bottom row of {0, 0, 0, 1}
+    static Mat4 affine_inverse(const Mat4& mat);
+
+    static f32 determinant_3x3(const Mat4& mat);
+
+    // Length of the longest transformed basis vector, the most that mat stretches any distance
+    static f32 max_axis_scale(const Mat4& mat);
+
     const Vec4& operator[](usize row_index) const;
     Vec4& operator[](usize row_index);
 
@@ -235,4 +249,33 @@ namespace math {
     f32 to_degrees(f32 radians);
 
     Vec4 perspective_divide(Vec4 vec);
+
+
+    // Batch kernels
+    //
+    // Vectorized over the whole span, results match the scalar operators bit for bit. Input and output spans must
+    // have the same size.
+
+    // Structure of arrays views over points, one stream per component
+    struct Vec3_Streams {
+        std::span<const f32> x;
+        std::span<const f32> y;
+        std::span<const f32> z;
+    };
+
+    struct Vec4_Streams {
+        std::span<f32> x;
+        std::span<f32> y;
+        std::span<f32> z;
+        std::span<f32> w;
+    };
+
+    // mat * {point, 1} for every point
+    void transform_points(const Mat4& mat, std::span<const Vec3> points, std::span<Vec4> transformed_points);
+    void transform_points(const Mat4& mat, Vec3_Streams points, Vec4_Streams transformed_points);
+
+    // Perspective divide, y flip and viewport mapping of clip space points to {x, y} in pixels, z in normalized device
+    // depth. w is kept.
+    void project_to_viewport(std::span<const Vec4> clip_points, Vec2 viewport_size, std::span<Vec4> screen_points);
+    void project_to_viewport(Vec4_Streams clip_points, Vec2 viewport_size, Vec4_Streams screen_points);
 }
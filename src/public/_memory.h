@@ -0,0 +1,120 @@
+#pragma once
+#include "_common.h"
+
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+
+
+// Allocator for std containers whose storage must start on an alignment boundary, e.g. streams read with SIMD loads.
+template <typename T, usize alignment>
+struct Aligned_Allocator {
+    static_assert(alignment >= alignof(T) && (alignment & (alignment - 1)) == 0);
+
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = Aligned_Allocator<U, alignment>;
+    };
+
+    Aligned_Allocator() = default;
+
+    template <typename U>
+    explicit Aligned_Allocator(const Aligned_Allocator<U, alignment>&) {}
+
+    T* allocate(const usize count) {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t{alignment}));
+    }
+
+    void deallocate(T* ptr, const usize count) {
+        ::operator delete(ptr, count * sizeof(T), std::align_val_t{alignment});
+    }
+
+    template <typename U>
+    bool operator==(const Aligned_Allocator<U, alignment>&) const { return true; }
+};
+
+
+// 32 bytes covers the widest registers used by _simd.h
+constexpr usize simd_alignment = 32;
+
+template <typename T>
+using Aligned_Vector = std::vector<T, Aligned_Allocator<T, simd_alignment>>;
+
+
+// Bump allocator for data that only lives until the end of the frame. Allocating moves an offset, nothing gets freed on
+// its own, reset() releases everything at once. A frame that outgrows the block spills into extra blocks, which the
+// next reset() merges into one block large enough for the whole frame, so steady state frames never touch the heap.
+struct Frame_Arena {
+    static constexpr usize default_capacity = 1 << 20;
+
+    explicit Frame_Arena(usize capacity = default_capacity);
+    ~Frame_Arena();
+
+    Frame_Arena(const Frame_Arena&) = delete;
+    Frame_Arena& operator=(const Frame_Arena&) = delete;
+
+    void* allocate(usize size, usize alignment);
+
+    // Value initialized, only for types that don't need destructors since the arena never runs them
+    template <typename T>
+    std::span<T> allocate_array(const usize count) {
+        static_assert(std::is_trivially_destructible_v<T>);
+
+        T* data = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        std::uninitialized_value_construct_n(data, count);
+        return std::span<T>{data, count};
+    }
+
+    // Everything allocated since the last reset becomes invalid
+    void reset();
+
+    usize get_capacity() const;
+
+private:
+    // Blocks start on a cache line, with alignments up to that allocations only ever pad within a block
+    static constexpr usize block_alignment = 64;
+
+    struct Block {
+        u8* data;
+        usize capacity;
+    };
+
+    std::vector<Block> blocks;   // allocations come from the last one
+    usize offset = 0;            // into the last block
+};
+
+
+// Allocator for std containers whose storage only lives until the arena gets reset. Freeing is a no-op, so containers
+// that grow leave their old storage behind until then, reserve them up front where the size can be estimated.
+template <typename T>
+struct Arena_Allocator {
+    using value_type = T;
+
+    Frame_Arena* arena;
+
+    explicit Arena_Allocator(Frame_Arena& arena) : arena(&arena) {}
+
+    template <typename U>
+    explicit Arena_Allocator(const Arena_Allocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(const usize count) { return static_cast<T*>(arena->allocate(count * sizeof(T), alignof(T))); }
+
+    void deallocate(T*, usize) {}
+
+    template <typename U>
+    bool operator==(const Arena_Allocator<U>& other) const { return arena == other.arena; }
+};
+
+template <typename T>
+using Arena_Vector = std::vector<T, Arena_Allocator<T>>;
+
+
+#if ENABLE_ALLOCATION_COUNTING
+namespace memory {
+    // Calls to the global operator new since startup, from every thread
+    u64 num_heap_allocations();
+}
+#endif
@@ -1,25 +1,84 @@
 #pragma once
 #include "_common.h"
 #include "_ecs.h"
+#include "_memory.h"
 #include "_types.h"
 
 
 struct Mesh_Render_System final : System {
-    explicit Mesh_Render_System(const Registry& reg);
+    explicit Mesh_Render_System(Registry& reg);
 
     void update(Registry& reg);
 
+    // Sent to the rasterizer by the last update, after culling and clipping
+    usize get_num_triangles_drawn() const;
+
 private:
     const Window_System& window;
     const Render_System& renderer;
+    Tile_Raster_System& tile_raster;
     const Camera_System& camera;
     const Asset_Store_System& asset_store;
+    const Bvh_System* bvh;   // optional, culls hierarchically when registered before this system
+    Frame_Arena& frame_arena;
+
+    std::vector<Entity> visible_entities;
+
+    struct Instance {
+        Mesh_Id mesh_id;
+        Entity entity;
+    };
+
+    struct Sphere_Streams {
+        Aligned_Vector<f32> center_x;
+        Aligned_Vector<f32> center_y;
+        Aligned_Vector<f32> center_z;
+        Aligned_Vector<f32> radius;
+
+        void resize(const usize count) {
+            center_x.resize(count);
+            center_y.resize(count);
+            center_z.resize(count);
+            radius.resize(count);
+        }
+
+        Bounding_Sphere_Streams view() { return Bounding_Sphere_Streams{center_x, center_y, center_z, radius}; }
+
+        Bounding_Sphere operator[](const usize index) const {
+            return Bounding_Sphere{Vec3{center_x[index], center_y[index], center_z[index]}, radius[index]};
+        }
+    };
+
+    // Visible candidates sorted by mesh, and per instance data of the mesh being drawn
+    std::vector<Instance> instances;
+    std::vector<Mat4> instance_world_matrices;
+    Sphere_Streams instance_spheres;   // world space
+    std::vector<u32> is_instance_outside;
+
+    struct Vertex_Streams {
+        Aligned_Vector<f32> x;
+        Aligned_Vector<f32> y;
+        Aligned_Vector<f32> z;
+        Aligned_Vector<f32> w;
+
+        void resize(const usize count) {
+            x.resize(count);
+            y.resize(count);
+            z.resize(count);
+            w.resize(count);
+        }
+
+        math::Vec4_Streams view() { return math::Vec4_Streams{x, y, z, w}; }
+
+        Vec4 operator[](const usize index) const { return Vec4{x[index], y[index], z[index], w[index]}; }
+    };
 
-    std::vector<Triangle> triangles_to_draw;
-    std::vector<f32> triangle_depth_values;
-    std::vector<usize> triangle_draw_order;
+    // Per instance vertex cache, reused between entities
+    Vertex_Streams clip_vertices;
+    Vertex_Streams screen_vertices;
 
-    std::vector<Color> triangle_draw_colors;
+    // Triangles to draw live in the frame arena, reserved for as many as the last frame drew
+    usize num_triangles_last_frame = 0;
 
     const Light light {
         .direction = Vec3{0.25f, -0.5f, 0.25f},
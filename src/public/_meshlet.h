@@ -0,0 +1,22 @@
+#pragma once
+#include "_common.h"
+#include "_types.h"
+
+#include <span>
+
+
+namespace meshlet {
+    constexpr usize max_vertices = 64;
+    constexpr usize max_faces = 124;
+
+    // Greedily grows meshlets over faces sharing vertices, preferring faces that add few new vertices and point along
+    // the meshlet's normal. face_order receives the original face index for every face, in meshlet order.
+    void build(std::span<const Vec3> vertices,
+               std::span<const Face_Vertex_Indices> faces,
+               std::span<const Vec3> face_normals,
+               std::vector<Meshlet>& meshlets,
+               std::vector<u32>& face_order);
+
+    // Conservative, true only if every face of the meshlet faces away from camera_position (object space)
+    bool is_backfacing(const Meshlet& meshlet, Vec3 camera_position);
+}
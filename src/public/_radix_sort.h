@@ -0,0 +1,17 @@
+#pragma once
+#include "_common.h"
+
+#include <span>
+
+
+// Least significant digit radix sort over 64-bit keys, linear in the number of keys and free of allocations. Meant for
+// draw keys, with floats packed through ordered_bits so that they compare correctly as unsigned integers.
+namespace radix_sort {
+    // Maps a float to an unsigned integer with the same order, negative values included
+    u32 ordered_bits(f32 value);
+
+    // Stable, one pass per byte of the keys. Bytes that are the same in every key are skipped, so keys with constant
+    // fields cost no more than narrower keys. values are moved along with their keys. The scratch buffers must hold at
+    // least as many elements as keys, the sorted result ends up in keys and values.
+    void sort(std::span<u64> keys, std::span<u32> values, std::span<u64> scratch_keys, std::span<u32> scratch_values);
+}
@@ -8,16 +8,39 @@
 
 
 struct Render_System final : System {
+    // Triangles with corners further away from the origin than this (in pixels) are not drawn. Keeps edge function
+    // steps well within 32 bits.
+    static constexpr f32 max_raster_coordinate = 1 << 13;
+
     explicit Render_System(Registry& registry);
 
-    void draw_grid(i32 x_step, i32 y_step, Color color) const;
+    void draw_grid(i32 x_step, i32 y_step, Color color) const; // background, has to be drawn every frame
     void draw_rect(Vec2i coord, Vec2i rect, Color color) const;
     void draw_line(Vec2i from, Vec2i to, Color color) const;
     void draw_triangle_wireframe(const Triangle& triangle, Color color) const;
     void draw_triangle_filled(const Triangle& triangle, Color color) const;
+    void draw_triangle_filled(const Raster_Triangle& triangle, Color color) const; // depth tested
+
+    // Depth tested, only touches pixels inside the clip rect. clip_max is inclusive.
+    void draw_triangle_filled(const Raster_Triangle& triangle, Color color, Vec2i clip_min, Vec2i clip_max) const;
 
 private:
     Window_System& window;
 
-    static Vec2 project_point(Vec3 point, f32 fov_factor);
+    // Edge function state of a triangle, starting at the center of the top left pixel of its bounding box. Edge values
+    // are in subpixels, including the fill rule bias: a pixel is covered when all three are >= 0.
+    struct Triangle_Setup {
+        Vec2i bounds_min;
+        Vec2i bounds_max;
+        std::array<i64, 3> w_origin;
+        std::array<i32, 3> w_step_x;
+        std::array<i32, 3> w_step_y;
+        std::array<f32, 3> barycentric_origin;
+        std::array<f32, 3> barycentric_step_x;
+        std::array<f32, 3> barycentric_step_y;
+        bool is_winding_flipped;
+    };
+
+    bool setup_triangle(const Triangle& triangle, Vec2i clip_min, Vec2i clip_max, Triangle_Setup& setup) const;
+    static i32 edge_value_at(const Triangle_Setup& setup, usize edge, Vec2i pixel);
 };
@@ -0,0 +1,234 @@
+#pragma once
+#include "_common.h"
+
+#include <algorithm>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define SIMD_AVX2 1
+#elif defined(__SSE2__) || defined(_M_X64)
+    #include <emmintrin.h>
+    #define SIMD_SSE2 1
+#endif
+
+
+// Thin wrappers over the widest available vector registers: 8 lanes with AVX2, 4 lanes with SSE2 and a single lane
+// scalar fallback. Kernels written against these process simd::width elements per operation. store_streaming writes
+// past the caches and needs dst aligned to the register size, streaming_fence orders it before later stores.
+namespace simd {
+
+
+#if SIMD_AVX2
+
+constexpr usize width = 8;
+
+struct F32_Lanes { __m256 v; };
+struct I32_Lanes { __m256i v; };
+struct Mask { __m256i v; }; // all bits set in active lanes
+
+inline F32_Lanes splat(const f32 scalar) { return {_mm256_set1_ps(scalar)}; }
+inline I32_Lanes splat(const i32 scalar) { return {_mm256_set1_epi32(scalar)}; }
+
+inline F32_Lanes load(const f32* src) { return {_mm256_loadu_ps(src)}; }
+inline I32_Lanes load(const i32* src) { return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src))}; }
+inline I32_Lanes load(const u32* src) { return {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src))}; }
+inline void store(f32* dst, const F32_Lanes a) { _mm256_storeu_ps(dst, a.v); }
+inline void store(u32* dst, const I32_Lanes a) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst), a.v); }
+inline void store_streaming(f32* dst, const F32_Lanes a) { _mm256_stream_ps(dst, a.v); }
+inline void store_streaming(u32* dst, const I32_Lanes a) { _mm256_stream_si256(reinterpret_cast<__m256i*>(dst), a.v); }
+inline void streaming_fence() { _mm_sfence(); }
+
+inline F32_Lanes operator+(const F32_Lanes a, const F32_Lanes b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline F32_Lanes operator-(const F32_Lanes a, const F32_Lanes b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline F32_Lanes operator*(const F32_Lanes a, const F32_Lanes b) { return {_mm256_mul_ps(a.v, b.v)}; }
+inline F32_Lanes operator/(const F32_Lanes a, const F32_Lanes b) { return {_mm256_div_ps(a.v, b.v)}; }
+inline F32_Lanes min(const F32_Lanes a, const F32_Lanes b) { return {_mm256_min_ps(a.v, b.v)}; }
+inline F32_Lanes max(const F32_Lanes a, const F32_Lanes b) { return {_mm256_max_ps(a.v, b.v)}; }
+inline F32_Lanes sqrt(const F32_Lanes a) { return {_mm256_sqrt_ps(a.v)}; }
+inline I32_Lanes operator+(const I32_Lanes a, const I32_Lanes b) { return {_mm256_add_epi32(a.v, b.v)}; }
+inline I32_Lanes operator-(const I32_Lanes a, const I32_Lanes b) { return {_mm256_sub_epi32(a.v, b.v)}; }
+inline I32_Lanes operator|(const I32_Lanes a, const I32_Lanes b) { return {_mm256_or_si256(a.v, b.v)}; }
+inline I32_Lanes operator&(const I32_Lanes a, const I32_Lanes b) { return {_mm256_and_si256(a.v, b.v)}; }
+inline I32_Lanes shift_left(const I32_Lanes a, const i32 bits) { return {_mm256_slli_epi32(a.v, bits)}; }
+inline I32_Lanes shift_right(const I32_Lanes a, const i32 bits) { return {_mm256_srli_epi32(a.v, bits)}; }
+
+inline F32_Lanes to_f32(const I32_Lanes a) { return {_mm256_cvtepi32_ps(a.v)}; }
+inline I32_Lanes to_i32_truncated(const F32_Lanes a) { return {_mm256_cvttps_epi32(a.v)}; }
+
+inline Mask operator&(const Mask a, const Mask b) { return {_mm256_and_si256(a.v, b.v)}; }
+inline Mask operator|(const Mask a, const Mask b) { return {_mm256_or_si256(a.v, b.v)}; }
+inline Mask less_than(const F32_Lanes a, const F32_Lanes b) {
+    return {_mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ))};
+}
+inline Mask equal(const F32_Lanes a, const F32_Lanes b) {
+    return {_mm256_castps_si256(_mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ))};
+}
+inline Mask greater_equal_zero(const I32_Lanes a) { return {_mm256_cmpgt_epi32(a.v, _mm256_set1_epi32(-1))}; }
+inline bool any(const Mask mask) { return _mm256_movemask_ps(_mm256_castsi256_ps(mask.v)) != 0; }
+
+inline f32 reduce_min(const F32_Lanes a) {
+    __m128 m = _mm_min_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    m = _mm_min_ps(m, _mm_movehl_ps(m, m));
+    return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+inline f32 reduce_max(const F32_Lanes a) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(a.v), _mm256_extractf128_ps(a.v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+
+inline F32_Lanes select(const Mask mask, const F32_Lanes if_true, const F32_Lanes if_false) {
+    return {_mm256_blendv_ps(if_false.v, if_true.v, _mm256_castsi256_ps(mask.v))};
+}
+inline I32_Lanes select(const Mask mask, const I32_Lanes if_true, const I32_Lanes if_false) {
+    return {_mm256_blendv_epi8(if_false.v, if_true.v, mask.v)};
+}
+
+#elif SIMD_SSE2
+
+constexpr usize width = 4;
+
+struct F32_Lanes { __m128 v; };
+struct I32_Lanes { __m128i v; };
+struct Mask { __m128i v; };
+
+inline F32_Lanes splat(const f32 scalar) { return {_mm_set1_ps(scalar)}; }
+inline I32_Lanes splat(const i32 scalar) { return {_mm_set1_epi32(scalar)}; }
+
+inline F32_Lanes load(const f32* src) { return {_mm_loadu_ps(src)}; }
+inline I32_Lanes load(const i32* src) { return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))}; }
+inline I32_Lanes load(const u32* src) { return {_mm_loadu_si128(reinterpret_cast<const __m128i*>(src))}; }
+inline void store(f32* dst, const F32_Lanes a) { _mm_storeu_ps(dst, a.v); }
+inline void store(u32* dst, const I32_Lanes a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), a.v); }
+inline void store_streaming(f32* dst, const F32_Lanes a) { _mm_stream_ps(dst, a.v); }
+inline void store_streaming(u32* dst, const I32_Lanes a) { _mm_stream_si128(reinterpret_cast<__m128i*>(dst), a.v); }
+inline void streaming_fence() { _mm_sfence(); }
+
+inline F32_Lanes operator+(const F32_Lanes a, const F32_Lanes b) { return {_mm_add_ps(a.v, b.v)}; }
+inline F32_Lanes operator-(const F32_Lanes a, const F32_Lanes b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline F32_Lanes operator*(const F32_Lanes a, const F32_Lanes b) { return {_mm_mul_ps(a.v, b.v)}; }
+inline F32_Lanes operator/(const F32_Lanes a, const F32_Lanes b) { return {_mm_div_ps(a.v, b.v)}; }
+inline F32_Lanes min(const F32_Lanes a, const F32_Lanes b) { return {_mm_min_ps(a.v, b.v)}; }
+inline F32_Lanes max(const F32_Lanes a, const F32_Lanes b) { return {_mm_max_ps(a.v, b.v)}; }
+inline F32_Lanes sqrt(const F32_Lanes a) { return {_mm_sqrt_ps(a.v)}; }
+inline I32_Lanes operator+(const I32_Lanes a, const I32_Lanes b) { return {_mm_add_epi32(a.v, b.v)}; }
+inline I32_Lanes operator-(const I32_Lanes a, const I32_Lanes b) { return {_mm_sub_epi32(a.v, b.v)}; }
+inline I32_Lanes operator|(const I32_Lanes a, const I32_Lanes b) { return {_mm_or_si128(a.v, b.v)}; }
+inline I32_Lanes operator&(const I32_Lanes a, const I32_Lanes b) { return {_mm_and_si128(a.v, b.v)}; }
+inline I32_Lanes shift_left(const I32_Lanes a, const i32 bits) { return {_mm_slli_epi32(a.v, bits)}; }
+inline I32_Lanes shift_right(const I32_Lanes a, const i32 bits) { return {_mm_srli_epi32(a.v, bits)}; }
+
+inline F32_Lanes to_f32(const I32_Lanes a) { return {_mm_cvtepi32_ps(a.v)}; }
+inline I32_Lanes to_i32_truncated(const F32_Lanes a) { return {_mm_cvttps_epi32(a.v)}; }
+
+inline Mask operator&(const Mask a, const Mask b) { return {_mm_and_si128(a.v, b.v)}; }
+inline Mask operator|(const Mask a, const Mask b) { return {_mm_or_si128(a.v, b.v)}; }
+inline Mask less_than(const F32_Lanes a, const F32_Lanes b) { return {_mm_castps_si128(_mm_cmplt_ps(a.v, b.v))}; }
+inline Mask equal(const F32_Lanes a, const F32_Lanes b) { return {_mm_castps_si128(_mm_cmpeq_ps(a.v, b.v))}; }
+inline Mask greater_equal_zero(const I32_Lanes a) { return {_mm_cmpgt_epi32(a.v, _mm_set1_epi32(-1))}; }
+inline bool any(const Mask mask) { return _mm_movemask_ps(_mm_castsi128_ps(mask.v)) != 0; }
+
+inline f32 reduce_min(const F32_Lanes a) {
+    const __m128 m = _mm_min_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    return _mm_cvtss_f32(_mm_min_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+inline f32 reduce_max(const F32_Lanes a) {
+    const __m128 m = _mm_max_ps(a.v, _mm_movehl_ps(a.v, a.v));
+    return _mm_cvtss_f32(_mm_max_ss(m, _mm_shuffle_ps(m, m, 1)));
+}
+
+inline F32_Lanes select(const Mask mask, const F32_Lanes if_true, const F32_Lanes if_false) {
+    const __m128 m = _mm_castsi128_ps(mask.v);
+    return {_mm_or_ps(_mm_and_ps(m, if_true.v), _mm_andnot_ps(m, if_false.v))};
+}
+inline I32_Lanes select(const Mask mask, const I32_Lanes if_true, const I32_Lanes if_false) {
+    return {_mm_or_si128(_mm_and_si128(mask.v, if_true.v), _mm_andnot_si128(mask.v, if_false.v))};
+}
+
+#else
+
+constexpr usize width = 1;
+
+struct F32_Lanes { f32 v; };
+struct I32_Lanes { i32 v; };
+struct Mask { bool v; };
+
+inline F32_Lanes splat(const f32 scalar) { return {scalar}; }
+inline I32_Lanes splat(const i32 scalar) { return {scalar}; }
+
+inline F32_Lanes load(const f32* src) { return {*src}; }
+inline I32_Lanes load(const i32* src) { return {*src}; }
+inline I32_Lanes load(const u32* src) { return {static_cast<i32>(*src)}; }
+inline void store(f32* dst, const F32_Lanes a) { *dst = a.v; }
+inline void store(u32* dst, const I32_Lanes a) { *dst = static_cast<u32>(a.v); }
+inline void store_streaming(f32* dst, const F32_Lanes a) { *dst = a.v; }
+inline void store_streaming(u32* dst, const I32_Lanes a) { *dst = static_cast<u32>(a.v); }
+inline void streaming_fence() {}
+
+inline F32_Lanes operator+(const F32_Lanes a, const F32_Lanes b) { return {a.v + b.v}; }
+inline F32_Lanes operator-(const F32_Lanes a, const F32_Lanes b) { return {a.v - b.v}; }
+inline F32_Lanes operator*(const F32_Lanes a, const F32_Lanes b) { return {a.v * b.v}; }
+inline F32_Lanes operator/(const F32_Lanes a, const F32_Lanes b) { return {a.v / b.v}; }
+inline F32_Lanes min(const F32_Lanes a, const F32_Lanes b) { return {std::min(a.v, b.v)}; }
+inline F32_Lanes max(const F32_Lanes a, const F32_Lanes b) { return {std::max(a.v, b.v)}; }
+inline F32_Lanes sqrt(const F32_Lanes a) { return {std::sqrt(a.v)}; }
+inline I32_Lanes operator+(const I32_Lanes a, const I32_Lanes b) { return {a.v + b.v}; }
+inline I32_Lanes operator-(const I32_Lanes a, const I32_Lanes b) { return {a.v - b.v}; }
+inline I32_Lanes operator|(const I32_Lanes a, const I32_Lanes b) { return {a.v | b.v}; }
+inline I32_Lanes operator&(const I32_Lanes a, const I32_Lanes b) { return {a.v & b.v}; }
+inline I32_Lanes shift_left(const I32_Lanes a, const i32 bits) {
+    return {static_cast<i32>(static_cast<u32>(a.v) << bits)};
+}
+inline I32_Lanes shift_right(const I32_Lanes a, const i32 bits) {
+    return {static_cast<i32>(static_cast<u32>(a.v) >> bits)};
+}
+
+inline F32_Lanes to_f32(const I32_Lanes a) { return {static_cast<f32>(a.v)}; }
+inline I32_Lanes to_i32_truncated(const F32_Lanes a) { return {static_cast<i32>(a.v)}; }
+
+inline Mask operator&(const Mask a, const Mask b) { return {a.v && b.v}; }
+inline Mask operator|(const Mask a, const Mask b) { return {a.v || b.v}; }
+inline Mask less_than(const F32_Lanes a, const F32_Lanes b) { return {a.v < b.v}; }
+inline Mask equal(const F32_Lanes a, const F32_Lanes b) { return {a.v == b.v}; }
+inline Mask greater_equal_zero(const I32_Lanes a) { return {a.v >= 0}; }
+inline bool any(const Mask mask) { return mask.v; }
+
+inline f32 reduce_min(const F32_Lanes a) { return a.v; }
+inline f32 reduce_max(const F32_Lanes a) { return a.v; }
+
+inline F32_Lanes select(const Mask mask, const F32_Lanes if_true, const F32_Lanes if_false) {
+    return mask.v ? if_true : if_false;
+}
+inline I32_Lanes select(const Mask mask, const I32_Lanes if_true, const I32_Lanes if_false) {
+    return mask.v ? if_true : if_false;
+}
+
+#endif
+
+
+// Smallest multiple of the lane count that holds count elements
+constexpr usize padded_to_width(const usize count) {
+    return ((count + width - 1) / width) * width;
+}
+
+
+// {start, start + step, start + 2 * step, ...}
+inline I32_Lanes sequence(const i32 start, const i32 step) {
+    alignas(32) std::array<i32, width> lanes;
+    for (usize lane = 0; lane < width; ++lane) {
+        lanes[lane] = start + (step * static_cast<i32>(lane));
+    }
+    return load(lanes.data());
+}
+
+
+inline F32_Lanes sequence(const f32 start, const f32 step) {
+    alignas(32) std::array<f32, width> lanes;
+    for (usize lane = 0; lane < width; ++lane) {
+        lanes[lane] = start + (step * static_cast<f32>(lane));
+    }
+    return load(lanes.data());
+}
+
+
+} // namespace simd
@@ -0,0 +1,21 @@
+#pragma once
+#include "_common.h"
+#include "_types.h"
+
+#include <span>
+
+
+// Mesh simplification with quadric error metrics (Garland & Heckbert). Edges are collapsed onto one of their existing
+// end points, so simplified meshes only need new faces and keep using the original vertices.
+namespace simplify {
+    // Collapses edges in order of increasing error until at most target_num_faces faces remain or no collapse is
+    // possible without flipping faces or breaking the surface topology. Border vertices are kept in place.
+    //
+    // Returns the largest collapse error, an upper bound on how far the simplified surface moved away from the planes
+    // of the original faces, in the units of the vertices.
+    f32 simplify(std::span<const Vec3> vertices,
+                 std::span<const Face_Vertex_Indices> faces,
+                 usize target_num_faces,
+                 std::vector<Face_Vertex_Indices>& simplified_faces,
+                 std::vector<u32>& simplified_face_origins);   // index into faces that every simplified face came from
+}
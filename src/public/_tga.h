@@ -1,5 +1,6 @@
 #pragma once
 
+#include "_color.h"
 #include "_common.h"
 #include <span>
 
@@ -75,4 +76,9 @@ struct Header_View {
 };
 
 
+// Converts the pixels of an uncompressed 24 or 32 bit image, data being the whole file, to one color each. 24 bit
+// pixels get an opaque alpha.
+void decode_pixels(const Header_View& header, std::span<const u8> data, std::span<Color> pixels);
+
+
 } // namespace tga
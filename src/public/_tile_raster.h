@@ -0,0 +1,64 @@
+#pragma once
+#include "_common.h"
+#include "_ecs.h"
+#include "_memory.h"
+#include "_types.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <span>
+#include <thread>
+
+
+// Splits the color buffer into fixed-size tiles, bins screen space triangles into the tiles they overlap and
+// rasterizes whole tiles in parallel. A tile is only ever touched by one thread, so no locking is needed on the
+// color or depth buffer.
+struct Tile_Raster_System final : System {
+    static constexpr i32 tile_size = 64; // pixels, along each axis
+
+    explicit Tile_Raster_System(Registry& reg, u32 num_worker_threads = default_num_worker_threads());
+    ~Tile_Raster_System() override;
+
+    // Depth tested. Returns once every triangle has been rasterized. Within a tile, triangles are drawn in
+    // submission order, or in draw_order (indices into triangles) when it isn't empty.
+    void draw_triangles_filled(std::span<const Raster_Triangle> triangles,
+                               std::span<const Color> colors,
+                               std::span<const u32> draw_order = {});
+
+    static u32 default_num_worker_threads();
+
+    Tile_Raster_System(const Tile_Raster_System&) = delete;
+    Tile_Raster_System(const Tile_Raster_System&&) = delete;
+
+private:
+    const Window_System& window;
+    const Render_System& renderer;
+    Frame_Arena& frame_arena;
+
+    i32 num_tiles_x;
+    i32 num_tiles_y;
+
+    // Triangle indices of all tiles back to back in the frame arena, the ones of tile i are in
+    // [bin_starts[i], bin_starts[i + 1])
+    std::span<u32> bin_starts;
+    std::span<u32> binned_triangles;
+
+    // Current job, read by the workers while rasterizing
+    std::span<const Raster_Triangle> job_triangles;
+    std::span<const Color> job_colors;
+    std::span<const u32> job_draw_order;
+    std::atomic<u32> next_tile_index;
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable job_started;
+    std::condition_variable job_finished;
+    u64 job_generation;
+    u32 num_workers_running;
+    bool is_shutting_down;
+
+    void bin_triangles();
+    void rasterize_tiles();
+    void worker_loop();
+};
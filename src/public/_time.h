@@ -11,6 +11,10 @@ struct Time_System final : System {
 
     f32 get_delta_seconds() const;
 
+    // Every update reports this delta instead of the measured one, for runs that have to be reproducible. 0 goes back
+    // to measuring.
+    void set_fixed_delta_seconds(f32 seconds);
+
 private:
     using Clock = std::chrono::high_resolution_clock;
     using Instant = std::chrono::time_point<std::chrono::system_clock>;
@@ -20,6 +24,7 @@ private:
     Instant last_time;
     u64 delta_nanoseconds;
     f32 delta_seconds;
+    f32 fixed_delta_seconds;
 
     consteval static i32 ns_per_us() { return 1000; } // ns/µs, nanoseconds per microsecond
     consteval static i32 ns_per_ms() { return 1000 * ns_per_us(); } // ns/ms, nanoseconds per millisecond
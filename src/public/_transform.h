@@ -0,0 +1,33 @@
+#pragma once
+#include "_common.h"
+#include "_ecs.h"
+#include "_math.h"
+#include "_types.h"
+
+
+// Scene graph over every entity with a Transform. World matrices are only recomputed for transforms that changed and
+// everything below them, walking an array sorted so that parents come before their children.
+struct Transform_System final : System {
+    explicit Transform_System();
+
+    void update(Registry& reg);
+
+    // Moves child below parent, or to the root with Transform::no_parent. The child keeps its local values, so it
+    // jumps to the same place relative to its new parent. Must not create cycles.
+    void set_parent(Registry& reg, Entity child, Entity parent);
+
+private:
+    static constexpr u32 no_parent_index = static_cast<u32>(-1);
+
+    struct Node {
+        Entity entity;
+        u32 parent_index;   // into nodes, always before the node itself
+    };
+
+    std::vector<Node> nodes;               // topologically sorted, parents before children
+    std::vector<Mat4> world_matrices;      // per node, parents are read from here instead of their components
+    std::vector<bool> has_world_changed;   // per node, during update
+    bool is_order_valid = false;
+
+    void sort_nodes(Registry& reg);
+};
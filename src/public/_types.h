@@ -2,21 +2,32 @@
 #include <span>
 
 #include "_common.h"
+#include "_bounds.h"
 #include "_color.h"
+#include "_ecs.h"
 #include "_math.h"
 
 
 struct Asset_Store_System;
+struct Bvh_System;
 struct Camera_System;
 struct Render_System;
+struct Tile_Raster_System;
+struct Transform_System;
 struct Window_System;
 
 
-using Triangle = std::array<Vec2i, 3>;
+using Triangle = std::array<Vec2, 3>; // screen space, in pixels
 using Face_Vertex_Indices = std::array<u16, 3>;
 using Face_UV_Indices = std::array<u16, 3>;
 
 
+struct Raster_Triangle {
+    Triangle corners;
+    std::array<f32, 3> depths;   // normalized device depth per corner
+};
+
+
 struct Light {
     Vec3 direction;
 };
@@ -27,9 +38,40 @@ struct Mesh_Id {
 };
 
 
+// Cluster of neighbouring faces that is culled as a whole, see _meshlet.h. Meshlets reference a contiguous range of the
+// mesh's faces, meshes are reordered at load time to make that possible.
+struct Meshlet {
+    u32 faces_start;              // relative to the mesh's first face
+    u32 num_faces;
+
+    Bounding_Sphere sphere;       // object space
+
+    // Every face normal is within the cone around cone_axis. cone_cutoff is the sine of the cone's half angle, above
+    // 1 when the normals spread too far for the cone to be useful.
+    Vec3 cone_axis;
+    f32 cone_cutoff;
+};
+
+
+// Level of detail, a simplified version of the mesh. Level 0 is the full mesh. Positions are available both as an
+// array of structures and as structure of arrays streams for vectorized kernels. Each stream starts aligned to the SIMD
+// register size and holds simd::padded_to_width(vertices.size()) elements, the padding is zeroed.
+struct Mesh_Lod {
+    std::span<const Vec3> vertices;
+    math::Vec3_Streams positions;
+    std::span<const Face_Vertex_Indices> faces;
+    std::span<const Vec3> face_normals;   // object space, not normalized
+    std::span<const Meshlet> meshlets;
+    f32 error;                            // object space distance the faces may deviate from the full mesh
+};
+
+constexpr usize max_mesh_lods = 4;
+
+
 struct Mesh_View {
-    std::span<Vec3> vertices;
-    std::span<Face_Vertex_Indices> faces;
+    std::array<Mesh_Lod, max_mesh_lods> lods;   // increasingly coarse
+    usize num_lods;
+    Bounds bounds;                              // object space
 };
 
 
@@ -48,14 +90,57 @@ struct Texture_View {
 
 
 
+// Local translation, rotation and scale relative to the parent, world matrices are cached by Transform_System. The
+// local values are only changed through the setters, so that the world matrix never misses a change.
 struct Transform {
-    Mat4 world_matrix;
+    static constexpr Entity no_parent = static_cast<Entity>(-1);
+
+    explicit Transform(const Vec3 in_translation = Vec3::zeroed(),
+                       const Vec3 in_rotation = Vec3::zeroed(),
+                       const Vec3 in_scale = Vec3::splat(1.f))
+        : translation(in_translation),
+          rotation(in_rotation),
+          scale(in_scale) {
+    }
+
+    Vec3 get_translation() const { return translation; }
+    Vec3 get_rotation() const { return rotation; }
+    Vec3 get_scale() const { return scale; }
+    Entity get_parent() const { return parent; }   // see Transform_System::set_parent for changing it
+
+    const Mat4& get_world_matrix() const { return world_matrix; }
+    u32 get_world_matrix_version() const { return world_matrix_version; }   // bumped whenever world_matrix changes
+
+    void set_translation(const Vec3 new_translation) {
+        translation = new_translation;
+        is_dirty = true;
+    }
+
+    void set_rotation(const Vec3 new_rotation) {
+        rotation = new_rotation;
+        is_dirty = true;
+    }
+
+    void set_scale(const Vec3 new_scale) {
+        scale = new_scale;
+        is_dirty = true;
+    }
+
+private:
+    friend struct Transform_System;
+
     Vec3 translation;
     Vec3 rotation;
-    Vec3 scale = Vec3{1.f, 1.f, 1.f};
+    Vec3 scale;
+    Entity parent = no_parent;
+
+    Mat4 local_matrix;
+    Mat4 world_matrix;
+    u32 world_matrix_version = 0;
+    bool is_dirty = true;               // local values changed since the world matrix was computed
 
-    void update_world_matrix() {
-        world_matrix = Mat4::translation(translation) *
+    void update_local_matrix() {
+        local_matrix = Mat4::translation(translation) *
                        Mat4::rot_z(rotation.z) *
                        Mat4::rot_y(rotation.y) *
                        Mat4::rot_x(rotation.x) *
@@ -1,12 +1,19 @@
 #pragma once
 
+#include "_color.h"
 #include "_common.h"
 #include "_ecs.h"
+#include "_memory.h"
 
-#include <SDL2/SDL.h>
+#include <condition_variable>
+#include <mutex>
+#include <span>
+#include <thread>
 #include <vector>
 
-struct Color;
+struct SDL_Window;
+struct SDL_Renderer;
+struct SDL_Texture;
 
 
 struct Window_System final : System {
@@ -17,20 +24,112 @@ struct Window_System final : System {
     SDL_Renderer* sdl_renderer;
     SDL_Texture* sdl_color_buffer_texture;
 
-    std::vector<Color> color_buffer;
+    // Rows are color_buffer_pitch pixels apart, which may be more than width. Depending on the present mode it points
+    // straight into the locked streaming texture, or into one of the frame buffers.
+    std::span<Color> color_buffer;
+    i32 color_buffer_pitch;
+    Aligned_Vector<f32> depth_buffer; // normalized device depth, 0 at the near plane and 1 at the far plane
+
+    // Coarse hierarchical depth: the min and max depth of every depth_block_size x depth_block_size block of the
+    // depth buffer, so that whole blocks can be rejected before any per-pixel work.
+    static constexpr i32 depth_block_size = 8;
+    i32 num_depth_blocks_x;
+    i32 num_depth_blocks_y;
+    std::vector<f32> depth_block_min;
+    std::vector<f32> depth_block_max;
+
+    enum class Present_Mode {
+        Zero_Copy,   // rasterize into the locked texture, present on the calling thread
+        Copy,        // rasterize into a frame buffer, copy it into the texture and present on the calling thread
+        Async,       // rasterize into one frame buffer while the copy thread moves another one into the texture.
+                     // Uploading and presenting stay on the calling thread, a frame is shown one present() later.
+        Headless,    // rasterize into a frame buffer that is never shown
+    };
+
+    // Frame buffers Async rotates through. With three of them rendering never waits for the copy thread, with two it
+    // waits whenever a frame is handed off while the previous one is still being copied.
+    static constexpr usize min_frame_buffers = 2;
+    static constexpr usize max_frame_buffers = 3;
 
     explicit Window_System();
     ~Window_System() override;
-    bool init(i32 resolution_width, i32 resolution_height, bool real_fullscreen);
+
+    // Zero_Copy falls back to Copy when the texture can't be viewed as a color buffer. num_async_frame_buffers is only
+    // used by Async.
+    bool init(i32 resolution_width,
+              i32 resolution_height,
+              bool real_fullscreen,
+              Present_Mode requested_present_mode = Present_Mode::Zero_Copy,
+              usize num_async_frame_buffers = max_frame_buffers);
+
+    // Renders into the color buffer only, without SDL, a window or a display. present() just starts the next frame.
+    bool init_headless(i32 resolution_width, i32 resolution_height);
 
     bool poll_events() const;
 
     void clear_color_buffer(Color in_color);
+    void clear_depth_buffer(); // only the blocks that were written to
+    void update_depth_block(i32 block_x, i32 block_y); // recalculate min and max depth after writing to the block
+    void mark_color_block_dirty(i32 block_x, i32 block_y); // after writing to the block, outside of set_pixel
     void set_pixel(i32 x, i32 y, Color color); // (in color buffer)
-    bool present(); // present color buffer to the screen
+
+    // For backgrounds drawn the same way every frame. Doesn't mark the block dirty, blocks nothing else wrote to keep
+    // the background between frames instead of getting cleared.
+    void set_background_pixel(i32 x, i32 y, Color color);
+    bool present(); // present color buffer to the screen, then clear color and depth
+
+    struct Present_Stats {
+        u64 num_presented;
+        u64 num_dropped;   // replaced by a newer frame before the copy thread got to them
+        u64 num_late;      // handed off while every other frame buffer was still in use, rendering had to wait
+    };
+
+    Present_Stats get_present_stats() const;
 
     Window_System(const Window_System&) = delete;
     Window_System(const Window_System&&) = delete;
 private:
-    bool render_present_color_buffer() const;
+    Present_Mode present_mode;
+    bool is_color_buffer_texture_locked;
+
+    // Async present. A frame buffer is either being rendered into, waiting in the queue or being copied into the
+    // locked texture. A frame still in the queue when the next one arrives gets dropped, unless it is the only one
+    // there. SDL is only ever called from the thread that presents, the copy thread just writes the texture's pixels.
+    static constexpr usize no_frame_buffer = static_cast<usize>(-1);
+
+    usize num_frame_buffers;
+    std::array<Aligned_Vector<Color>, max_frame_buffers> frame_buffers;
+
+    // Per frame buffer and depth block, whether the block was written to since it was last cleared. Only the dirty
+    // blocks get cleared before the frame buffer is rendered into again.
+    std::array<std::vector<u8>, max_frame_buffers> dirty_color_blocks;
+    usize rendering_frame_buffer;
+    std::array<usize, max_frame_buffers> present_queue;   // oldest frame first
+    usize present_queue_size;
+    usize copying_frame_buffer;
+
+    // Pixels of the locked texture, for the copy thread to write the next frame into. Once it did, is_frame_staged
+    // hands the texture back until present() showed the frame and locked it again.
+    u8* staging_pixels;
+    i32 staging_pitch;   // in bytes
+    bool is_frame_staged;
+
+    std::thread copy_thread;
+    mutable std::mutex present_mutex;
+    std::condition_variable frame_queued;
+    std::condition_variable frame_buffer_freed;
+    Present_Stats present_stats;
+    bool is_shutting_down;
+
+    void init_buffers();
+    void clear_dirty_color_blocks(Color in_color);
+    bool lock_color_buffer_texture();
+    bool lock_staging_texture();
+    bool render_present_color_buffer();
+    bool copy_to_texture_and_present(std::span<const Color> pixels, i32 pixels_pitch) const;
+    bool render_present_texture() const;
+    bool present_staged_frame();
+    bool queue_frame_for_present();
+    usize find_free_frame_buffer() const;
+    void copy_loop();
 };